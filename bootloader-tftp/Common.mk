@@ -6,8 +6,15 @@ DEFINES+=DISABLE_PRINTF_FLOAT
 DEFINES+=ENABLE_TFTP_SERVER
 DEFINES+=CONFIG_REMOTECONFIG_MINIMUM
 DEFINES+=CONFIG_CLIB_USE_UART0
+DEFINES+=CONFIG_HAVE_CRC32_HW
+DEFINES+=CONFIG_FIRMWARE_AB_SLOTS
+DEFINES+=CONFIG_FIRMWARE_DELTA
+DEFINES+=CONFIG_FIRMWARE_LZ4
+# Accept uploads without the image info (image_crc.py), they are not verified
+#DEFINES+=CONFIG_FIRMWARE_ACCEPT_UNSTAMPED
 
 DEFINES+=UDP_MAX_PORTS_ALLOWED=3
+DEFINES+=UDP_MAX_COPY_PORTS=2
 
 DEFINES+=RTL8201F_LED1_LINK_ALL
 
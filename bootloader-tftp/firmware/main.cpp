@@ -37,6 +37,10 @@
 #include "flashcodeinstall.h"
 #include "configstore.h"
 #include "firmware.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "bootcontrol.h"
+#endif
+#include "tftp/tftpfileserver.h"
 #include "gd32.h"
 
 namespace board {
@@ -66,8 +70,18 @@ int main() {
 
     const auto kIsNotRemote = (bkp_data_read(BKP_DATA_1) != 0xA5A5);
     const auto kIsNotKey = (gpio_input_bit_get(KEY_BOOTLOADER_TFTP_GPIOx, KEY_BOOTLOADER_TFTP_GPIO_PINx));
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    // A pending slot until it is confirmed or out of tries, otherwise the active slot
+    const auto kSlot = (kIsNotRemote && kIsNotKey) ? bootcontrol::Select() : bootcontrol::Slot::kNone;
+    const auto kIsApplication = (kSlot != bootcontrol::Slot::kNone);
+    const uint32_t kImage = FLASH_BASE + bootcontrol::SlotOffset(kSlot);
+#else
+    // An interrupted or rejected upload leaves no valid vector table: stay in the bootloader
+    const auto kIsApplication = tftpfileserver::is_valid(reinterpret_cast<const void*>(FLASH_BASE + OFFSET_UIMAGE));
+    const uint32_t kImage = FLASH_BASE + OFFSET_UIMAGE;
+#endif
 
-    if (kIsNotRemote && kIsNotKey) {
+    if (kIsNotRemote && kIsNotKey && kIsApplication) {
         // https://developer.arm.com/documentation/ka001423/1-0
         // 1. Disable interrupt response.
         __disable_irq();
@@ -88,7 +102,7 @@ int main() {
         SysTick->CTRL = 0;
         SCB->ICSR |= SCB_ICSR_PENDSTCLR_Msk;
         // 5. Load the vector table address of user application code in to VTOR.
-        SCB->VTOR = FLASH_BASE + OFFSET_UIMAGE;
+        SCB->VTOR = kImage;
         // 6. Use the MSP as the current SP.
         // Set the MSP with the value from the vector table used by the application.
         __set_MSP((reinterpret_cast<unsigned int*>((SCB->VTOR))[0]));
@@ -97,7 +111,7 @@ int main() {
         // 7. Enable interrupts.
         __enable_irq();
         // 8. Call the reset handler
-        const uint32_t* reset_p = reinterpret_cast<uint32_t*>(FLASH_BASE + OFFSET_UIMAGE + 4);
+        const uint32_t* reset_p = reinterpret_cast<uint32_t*>(kImage + 4);
         asm volatile("bx %0;" : : "r"(*reset_p));
     }
 
@@ -108,7 +122,10 @@ int main() {
     FirmwareVersion fw(kSoftwareVersion, __DATE__, __TIME__);
     FlashCodeInstall flashcode_install;
 
-    printf("Remote=%c, Key=%c\n", kIsNotRemote ? 'N' : 'Y', kIsNotKey ? 'N' : 'Y');
+    printf("Remote=%c, Key=%c, Application=%c\n", kIsNotRemote ? 'N' : 'Y', kIsNotKey ? 'N' : 'Y', kIsApplication ? 'Y' : 'N');
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    printf("Active slot=%c\n", bootcontrol::Active() == bootcontrol::Slot::kB ? 'B' : 'A');
+#endif
     fw.Print("Bootloader TFTP Server");
 
     RemoteConfig remote_config(remoteconfig::Output::CONFIG);
@@ -42,13 +42,20 @@ ifeq ($(strip $(BOARD)),BOARD_GD32F407RE)
 	DEFINES+=-DCONFIG_STORE_USE_SPI
 endif
 	
+# CONFIG_STORE_JOURNAL changes the layout of the store on the device.
+# It is a board option, the bootloader and the application must be built with the same layout.
+# A journal build migrates the store from the layout without one at the first Commit.
+# On a device with erase units larger than 32K (GD32F4xx internal flash) the journal is refused,
+# the store is then double buffered (two copies), as without CONFIG_STORE_JOURNAL.
 ifeq ($(strip $(BOARD)),BOARD_GD32F450VI)
 	MCU=GD32F450VI
+	DEFINES+=-DCONFIG_STORE_JOURNAL
 endif
 
 ifeq ($(strip $(BOARD)),BOARD_16X4U_PIXEL)
 	MCU=GD32F450VI
 	DEFINES+=-DCONFIG_STORE_USE_SPI
+	DEFINES+=-DCONFIG_STORE_JOURNAL
 endif
 
 ifeq ($(strip $(BOARD)),BOARD_GD32F470VG)
@@ -96,4 +103,13 @@ endif
 
 ifndef MCU
 	$(error BOARD is not configured)
+endif
+
+# CONFIG_FIRMWARE_AB_SLOTS has the boot control sectors in the second flash bank, at 1M
+ifneq (,$(findstring CONFIG_FIRMWARE_AB_SLOTS,$(DEFINES)))
+  ifeq ($(MCU),GD32F450VI)
+  else ifeq ($(MCU),GD32F470ZK)
+  else
+    $(error CONFIG_FIRMWARE_AB_SLOTS is not supported for $(MCU))
+  endif
 endif
\ No newline at end of file
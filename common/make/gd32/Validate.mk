@@ -38,10 +38,11 @@ endif
 
 ifeq ($(findstring CONFIG_REMOTECONFIG_MINIMUM,$(FLAGS)),CONFIG_REMOTECONFIG_MINIMUM)
 	DEFINES+=-DCONFIG_NET_APPS_NO_MDNS
-else
-	DEFINES+=-DCONFIG_EMAC_HASH_MULTICAST_FILTER
 endif
 
+# The EMAC filters in hardware, the multicast groups joined are in the hash table
+DEFINES+=-DCONFIG_EMAC_HASH_MULTICAST_FILTER
+
 ifeq ($(findstring RTL8201F,$(FLAGS)),RTL8201F)
   ifneq ($(findstring RTL8201F_LED1_LINK_ALL,$(FLAGS)),RTL8201F_LED1_LINK_ALL)
   	DEFINES+=-DRTL8201F_LED1_LINK_ALL
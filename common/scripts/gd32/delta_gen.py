@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+delta_gen.py
+
+Make a delta image for the TFTP bootloader (CONFIG_FIRMWARE_DELTA,
+see lib-flashcodeinstall firmware.h). The delta is applied in place
+against the image that is installed in the slot.
+
+Usage:
+  python3 delta_gen.py <installed.bin> <new.bin> <out.delta> [<slot offset>]
+
+The slot offset is the flash offset of the image, 0x8000 (slot A) by default,
+0x60000 for slot B. Upload the delta as "<firmware file name>.delta",
+for example "gd32f4xx.bin.delta".
+
+Format, little endian:
+- header: magic "AGDD", offset, base size, base CRC32, size, CRC32
+- patches in ascending offset order: offset, length, data
+The bytes not patched are taken from the installed image, bytes beyond
+the installed image are 0xFF.
+
+Limitation: the diff is positional, byte i of the new image against byte i
+of the installed one. There are no copy-from-base (move) records, code that
+moves is sent again. A change of code size early in the image shifts what
+follows, and the delta is then about as large as the full image.
+The delta pays off for builds with the same layout (a changed constant or
+string, a fix inside one function). The output says when it does not.
+"""
+
+from __future__ import annotations
+
+import struct
+import sys
+import zlib
+
+MAGIC = 0x44444741
+OFFSET_UIMAGE = 0x8000
+# A gap smaller than a patch header is cheaper to send as data
+PATCH_HEADER_SIZE = 8
+# Above this share of the image, the full (LZ4) image is the better upload
+DELTA_USEFUL_PERCENT = 50
+
+
+def patches(base: bytes, image: bytes) -> list[tuple[int, bytes]]:
+    padded = base[:len(image)].ljust(len(image), b"\xff")
+    result: list[tuple[int, int]] = []
+    i = 0
+    while i < len(image):
+        if padded[i] == image[i]:
+            i += 1
+            continue
+        start = i
+        while i < len(image) and padded[i] != image[i]:
+            i += 1
+        if result and start - result[-1][1] <= PATCH_HEADER_SIZE:
+            result[-1] = (result[-1][0], i)
+        else:
+            result.append((start, i))
+    return [(start, image[start:end]) for start, end in result]
+
+
+def make(base: bytes, image: bytes, offset: int) -> bytes:
+    delta = struct.pack("<IIIIII", MAGIC, offset, len(base), zlib.crc32(base), len(image), zlib.crc32(image))
+    for start, data in patches(base, image):
+        delta += struct.pack("<II", start, len(data)) + data
+    return delta
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) not in (4, 5):
+        print(f"Usage: {argv[0]} installed.bin new.bin out.delta [slot offset]", file=sys.stderr)
+        return 2
+
+    base = open(argv[1], "rb").read()
+    image = open(argv[2], "rb").read()
+    offset = int(argv[4], 0) if len(argv) == 5 else OFFSET_UIMAGE
+
+    delta = make(base, image, offset)
+    open(argv[3], "wb").write(delta)
+
+    percent = 100 * len(delta) // max(1, len(image))
+    print(f"{argv[3]}: {len(delta)} bytes, image {len(image)} bytes ({percent}%)")
+
+    if percent > DELTA_USEFUL_PERCENT:
+        print("The layout has moved (positional diff, no copy records): upload the full image instead", file=sys.stderr)
+
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main(sys.argv))
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+do-rx-soak.py
+
+Receive soak test for the EMAC Rx descriptor ring (CONFIG_EMAC_RXBUF_NUM).
+
+Usage:
+  python3 do-rx-soak.py <ip_address> <ring_depth> [<csv_file>]
+
+Behavior:
+- sends bursts of back-to-back '?version#' requests to the remote config port,
+  every request is answered, a request without an answer is a dropped frame
+- the burst sizes go from 1 up to 4 times the ring depth, ROUNDS bursts each
+- prints the drop rate per burst size, and appends it to <csv_file> when given
+- <ring_depth> is the value the firmware is built with, it labels the results.
+  Run it once per build to compare the drop rate against the ring depth.
+  Run do-tftp.py at the same time for the drops during the flash stalls.
+"""
+
+from __future__ import annotations
+
+import socket
+import sys
+sys.dont_write_bytecode = True
+import time
+
+PORT = 10501
+BUFLEN = 512
+REQUEST = b"?version#"
+ROUNDS = 100
+REPLY_TIMEOUT_SEC = 0.2
+
+
+def _drain(sock: socket.socket) -> None:
+    sock.setblocking(False)
+    try:
+        while True:
+            sock.recv(BUFLEN)
+    except (BlockingIOError, socket.timeout):
+        pass
+    sock.setblocking(True)
+
+
+def _burst(sock: socket.socket, ip: str, size: int) -> int:
+    for _ in range(size):
+        sock.sendto(REQUEST, (ip, PORT))
+
+    received = 0
+    deadline = time.monotonic() + REPLY_TIMEOUT_SEC
+    while received < size:
+        remaining = deadline - time.monotonic()
+        if remaining <= 0:
+            break
+        sock.settimeout(remaining)
+        try:
+            _data, (from_ip, _port) = sock.recvfrom(BUFLEN)
+        except socket.timeout:
+            break
+        if from_ip == ip:
+            received += 1
+    return received
+
+
+def soak(ip: str, depth: int) -> list[tuple[int, int, int]]:
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("", PORT))
+
+    sizes = sorted({1, 2, 4} | {depth // 2, depth, depth + 1, 2 * depth, 4 * depth} - {0})
+    results = []
+
+    for size in sizes:
+        sent = 0
+        received = 0
+        for _ in range(ROUNDS):
+            _drain(sock)
+            sent += size
+            received += _burst(sock, ip, size)
+        results.append((size, sent, received))
+        print(f"depth {depth:3d} burst {size:4d}: sent {sent:6d} received {received:6d} drop {100.0 * (sent - received) / sent:6.2f}%")
+
+    sock.close()
+    return results
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) < 3:
+        print(f"Usage: {argv[0]} ip_address ring_depth [csv_file]", file=sys.stderr)
+        return 2
+
+    ip = argv[1]
+    depth = int(argv[2])
+
+    results = soak(ip, depth)
+
+    if len(argv) > 3:
+        with open(argv[3], "a", encoding="utf-8") as csv:
+            for size, sent, received in results:
+                csv.write(f"{depth},{size},{sent},{received},{(sent - received) / sent:.4f}\n")
+
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main(sys.argv))
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""
+do-tftp-multicast.py
+
+Send one firmware image to a group of nodes with a single multicast DATA
+stream (TFTPDaemon multicast option, see lib-network/src/apps/tftp).
+
+Usage:
+  python3 do-tftp-multicast.py <group> <file> <master_ip> [<ip> ...]
+
+Behavior:
+- toggles tftp on for every node (same as do-tftp.py)
+- sends a unicast WRQ with the options blksize, windowsize, tsize and
+  multicast "<group>,<port>,<mc>" to every node, the first node is the master
+- streams the DATA blocks to <group>:<port>; the master acknowledges every
+  window, the other nodes send an ACK of their last in-order block (a NAK)
+  when they miss a block. The stream restarts from the lowest NAK.
+- the transfer is done when every node has acknowledged the last block
+- toggles tftp off for every node
+"""
+
+from __future__ import annotations
+
+import os
+import socket
+import struct
+import sys
+sys.dont_write_bytecode = True
+import time
+
+import udp_send  # expects udp_send.py to be importable (same dir or PYTHONPATH)
+
+PORT = 10501
+BUFLEN = 512
+TIMEOUT_SEC = 1.0
+
+TFTP_PORT = 69
+MULTICAST_PORT = 1758
+BLKSIZE = 1428
+WINDOWSIZE = 16
+RETRIES = 5
+
+OP_WRQ = 2
+OP_DATA = 3
+OP_ACK = 4
+OP_ERROR = 5
+OP_OACK = 6
+
+
+def _udp_cmd(ip: str, cmd: str) -> str:
+    _sent, reply = udp_send.send_and_maybe_recv(
+        ip, cmd.encode("utf-8"), port=PORT, local_port=PORT, timeout_sec=TIMEOUT_SEC, buf_len=BUFLEN
+    )
+    if not reply:
+        return ""
+    return reply.decode("utf-8", errors="replace").rstrip("\r\n")
+
+
+def _set_tftp(ip: str, on: bool) -> None:
+    wanted = "tftp:On" if on else "tftp:Off"
+    cmd = "!tftp#1" if on else "!tftp#0"
+    while True:
+        _udp_cmd(ip, cmd)
+        reply = _udp_cmd(ip, "?tftp#")
+        print(f"{ip} [{reply}]")
+        if reply == wanted:
+            return
+        time.sleep(1.0)
+
+
+def _wrq(filename: str, size: int, group: str, is_master: bool) -> bytes:
+    options = {
+        "blksize": str(BLKSIZE),
+        "windowsize": str(WINDOWSIZE),
+        "tsize": str(size),
+        "multicast": f"{group},{MULTICAST_PORT},{1 if is_master else 0}",
+    }
+    packet = struct.pack("!H", OP_WRQ) + filename.encode() + b"\0octet\0"
+    for name, value in options.items():
+        packet += name.encode() + b"\0" + value.encode() + b"\0"
+    return packet
+
+
+def _text(data: bytes) -> str:
+    return data.split(b"\0", 1)[0].decode(errors="replace")
+
+
+def _recv(sock: socket.socket, timeout: float):
+    sock.settimeout(timeout)
+    try:
+        data, (ip, _port) = sock.recvfrom(2048)
+    except socket.timeout:
+        return None
+    if len(data) < 4:
+        return None
+    opcode, arg = struct.unpack("!HH", data[:4])
+    return ip, opcode, arg, data[4:]
+
+
+def transfer(group: str, filepath: str, nodes: list[str]) -> bool:
+    image = open(filepath, "rb").read()
+    blocks = len(image) // BLKSIZE + 1  # the last block is always short (may be empty)
+    master = nodes[0]
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.bind(("", 0))
+
+    # Request phase: one unicast WRQ per node, answered with an OACK
+    pending = set(nodes)
+    for _ in range(RETRIES):
+        for ip in pending:
+            sock.sendto(_wrq(os.path.basename(filepath), len(image), group, ip == master), (ip, TFTP_PORT))
+        deadline = time.monotonic() + TIMEOUT_SEC
+        while pending and time.monotonic() < deadline:
+            reply = _recv(sock, max(0.0, deadline - time.monotonic()))
+            if reply is None:
+                continue
+            ip, opcode, arg, data = reply
+            if opcode == OP_OACK and ip in pending:
+                pending.discard(ip)
+            elif opcode == OP_ERROR:
+                print(f"{ip} error {arg}: {_text(data)}", file=sys.stderr)
+                return False
+        if not pending:
+            break
+    if pending:
+        print(f"No OACK from {sorted(pending)}", file=sys.stderr)
+        return False
+
+    # Data phase: windows to the group. The master paces the stream,
+    # a NAK from another node restarts it from that node's first missing block.
+    done = set()
+    next_block = 1
+    retries = 0
+    start = time.monotonic()
+
+    while len(done) < len(nodes):
+        last = min(next_block + WINDOWSIZE - 1, blocks)
+        for block in range(next_block, last + 1):
+            offset = (block - 1) * BLKSIZE
+            packet = struct.pack("!HH", OP_DATA, block & 0xFFFF) + image[offset:offset + BLKSIZE]
+            sock.sendto(packet, (group, MULTICAST_PORT))
+
+        master_acked = next_block - 1
+        resend_from = None
+        progress = False
+        deadline = time.monotonic() + TIMEOUT_SEC
+        while time.monotonic() < deadline:
+            reply = _recv(sock, max(0.0, deadline - time.monotonic()))
+            if reply is None:
+                continue
+            ip, opcode, arg, data = reply
+            if opcode == OP_ERROR:
+                print(f"{ip} error {arg}: {_text(data)}", file=sys.stderr)
+                return False
+            if opcode != OP_ACK or ip not in nodes:
+                continue
+            # 16-bit block number on the wire, signed distance to the window sent
+            delta = ((arg - (next_block - 1) + 0x8000) & 0xFFFF) - 0x8000
+            block = next_block - 1 + delta
+            if block > last:
+                continue
+            progress = True
+            if block == blocks:
+                done.add(ip)
+            if ip == master:
+                master_acked = max(master_acked, block)
+                if block == last:
+                    break
+            elif block < last:
+                resend_from = block + 1 if resend_from is None else min(resend_from, block + 1)
+                break
+
+        if progress:
+            retries = 0
+        else:
+            retries += 1
+            if retries > RETRIES:
+                print("Timeout", file=sys.stderr)
+                return False
+
+        next_block = master_acked + 1
+        if resend_from is not None:
+            next_block = min(next_block, resend_from)
+        next_block = max(1, min(next_block, blocks))
+
+    elapsed = time.monotonic() - start
+    print(f"{len(image)} bytes to {len(nodes)} nodes in {elapsed:.1f}s")
+    return True
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) < 4:
+        print(f"Usage: {argv[0]} group file master_ip [ip ...]", file=sys.stderr)
+        return 2
+
+    group = argv[1]
+    filepath = argv[2]
+    nodes = argv[3:]
+
+    if not os.path.isfile(filepath):
+        return 1
+
+    for ip in nodes:
+        _set_tftp(ip, True)
+
+    succes = transfer(group, filepath, nodes)
+
+    for ip in nodes:
+        _set_tftp(ip, False)
+
+    return 0 if succes else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main(sys.argv))
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+image_crc.py
+
+Stamp the image info into a GD32 firmware binary, so that the bootloader
+can verify the image while it is received (see lib-flashcodeinstall firmware.h).
+
+Usage:
+  python3 image_crc.py <file.bin>
+
+The reserved vector table entries 7, 8 and 9 are set to:
+- magic "AGD2"
+- image size
+- CRC32 of the image, without these 3 words
+"""
+
+from __future__ import annotations
+
+import struct
+import sys
+import zlib
+
+MAGIC = 0x32444741
+INFO_OFFSET = 7 * 4
+INFO_SIZE = 3 * 4
+
+
+def stamp(image: bytearray) -> int:
+    if len(image) < INFO_OFFSET + INFO_SIZE:
+        raise ValueError("image too small")
+    crc = zlib.crc32(image[:INFO_OFFSET])
+    crc = zlib.crc32(image[INFO_OFFSET + INFO_SIZE:], crc)
+    image[INFO_OFFSET:INFO_OFFSET + INFO_SIZE] = struct.pack("<III", MAGIC, len(image), crc)
+    return crc
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) != 2:
+        print(f"Usage: {argv[0]} file.bin", file=sys.stderr)
+        return 2
+
+    with open(argv[1], "rb") as f:
+        image = bytearray(f.read())
+
+    crc = stamp(image)
+
+    with open(argv[1], "wb") as f:
+        f.write(image)
+
+    print(f"{argv[1]}: size {len(image)}, crc32 {crc:08x}")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main(sys.argv))
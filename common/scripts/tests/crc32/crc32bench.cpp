@@ -0,0 +1,176 @@
+/**
+ * @file crc32bench.cpp
+ *
+ * Host benchmark of the crc32 variants, in MB/s.
+ * - bitwise: the reference, one bit per step
+ * - table: the byte-wise table (Sarwate) that lib-clib had before slicing-by-8
+ * - slicing8: lib-clib/src/crc32/crc32.cpp
+ * The GD32 CRC unit backend (lib-clib/src/gd32/crc32) runs on the target only.
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+uint32_t crc32_slicing8(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+namespace {
+uint32_t Bitwise(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+
+    while (len--) {
+        crc ^= *buf++;
+        for (uint32_t k = 0; k < 8; k++) {
+            crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+uint32_t s_table[256];
+
+void MakeTable() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (uint32_t k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        s_table[n] = c;
+    }
+}
+
+#define DO_CRC(x) crc = s_table[(crc ^ (x)) & 255] ^ (crc >> 8)
+
+uint32_t Table(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+
+    while (len && (reinterpret_cast<uintptr_t>(buf) & 3)) {
+        DO_CRC(*buf++);
+        len--;
+    }
+
+    for (; len >= 4; len -= 4) {
+        uint32_t word;
+        memcpy(&word, buf, 4);
+        buf += 4;
+        crc ^= word;
+        DO_CRC(0);
+        DO_CRC(0);
+        DO_CRC(0);
+        DO_CRC(0);
+    }
+
+    while (len--) {
+        DO_CRC(*buf++);
+    }
+
+    return ~crc;
+}
+
+struct Variant {
+    const char* name;
+    uint32_t (*crc32)(uint32_t, const uint8_t*, uint32_t);
+};
+
+constexpr Variant kVariants[] = {
+    {"bitwise", Bitwise},
+    {"table", Table},
+    {"slicing8", crc32_slicing8},
+};
+
+constexpr uint32_t kBufferSize = 256 * 1024;
+uint8_t s_buffer[kBufferSize + 8];
+uint32_t s_failures;
+
+double MegabytesPerSecond(const Variant& variant, const uint8_t* buf, uint32_t len) {
+    volatile uint32_t sink = 0;
+    uint32_t rounds = 0;
+    const auto kStart = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+
+    do {
+        sink = variant.crc32(sink, buf, len);
+        rounds++;
+        elapsed = std::chrono::steady_clock::now() - kStart;
+    } while (elapsed.count() < 0.2);
+
+    return (static_cast<double>(len) * rounds) / (elapsed.count() * 1024 * 1024);
+}
+
+void Verify() {
+    // Every alignment and tail length, and a running crc over split buffers
+    for (uint32_t offset = 0; offset < 8; offset++) {
+        for (uint32_t len = 0; len < 80; len++) {
+            const auto kExpected = Bitwise(0, &s_buffer[offset], len);
+            for (const auto& variant : kVariants) {
+                const auto kSplit = len / 3;
+                const auto kRunning = variant.crc32(variant.crc32(0, &s_buffer[offset], kSplit), &s_buffer[offset + kSplit], len - kSplit);
+                if ((variant.crc32(0, &s_buffer[offset], len) != kExpected) || (kRunning != kExpected)) {
+                    printf("FAIL: %s, offset=%u, len=%u\n", variant.name, static_cast<unsigned>(offset), static_cast<unsigned>(len));
+                    s_failures++;
+                }
+            }
+        }
+    }
+
+    // The check value of "123456789"
+    for (const auto& variant : kVariants) {
+        if (variant.crc32(0, reinterpret_cast<const uint8_t*>("123456789"), 9) != 0xcbf43926) {
+            printf("FAIL: %s, check value\n", variant.name);
+            s_failures++;
+        }
+    }
+}
+} // namespace
+
+int main() {
+    MakeTable();
+
+    srand(1);
+    for (auto& byte : s_buffer) {
+        byte = static_cast<uint8_t>(rand());
+    }
+
+    Verify();
+
+    static constexpr uint32_t kLengths[] = {512, 4096, kBufferSize};
+
+    printf("%-10s %8s %12s %12s\n", "variant", "length", "aligned", "unaligned");
+
+    for (const auto& variant : kVariants) {
+        for (const auto kLength : kLengths) {
+            printf("%-10s %8u %7.1f MB/s %7.1f MB/s\n", variant.name, static_cast<unsigned>(kLength), MegabytesPerSecond(variant, s_buffer, kLength), MegabytesPerSecond(variant, &s_buffer[1], kLength));
+        }
+    }
+
+    if (s_failures != 0) {
+        printf("%u failures\n", static_cast<unsigned>(s_failures));
+        return EXIT_FAILURE;
+    }
+
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+#
+# Host benchmark of the crc32 variants, in MB/s.
+# Usage: ./run.sh
+#
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+root="$dir/../../../.."
+out="${TMPDIR:-/tmp}/crc32bench"
+
+# The library crc32() is renamed, the benchmark links it next to the other variants
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -Dcrc32=crc32_slicing8 \
+	"$dir/crc32bench.cpp" "$root/lib-clib/src/crc32/crc32.cpp" -o "$out"
+
+"$out"
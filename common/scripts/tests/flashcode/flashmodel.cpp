@@ -0,0 +1,427 @@
+/**
+ * @file flashmodel.cpp
+ *
+ * Host test of the GD32F4xx FlashCode against a model of the FMC.
+ * FlashCode (lib-flashcode/src/gd32/f4xx/flashcode.cpp) is compared
+ * with the word-by-word path it is derived from: same flash content, same errors.
+ * The model has a clock: a word program keeps the FMC busy for kProgramNs,
+ * a status poll costs kPollNs, the superloop between two Write() calls kSuperloopNs.
+ * The programming time and the busy polls of both paths are compared:
+ * FlashCode must not be slower and must not poll a busy FMC more often.
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "flashcode.h"
+#include "gd32.h"
+#include "fmc_operation.h"
+
+namespace flashmodel {
+static constexpr uint32_t kSize = 1024 * 1024; // Bank 0
+static constexpr uint64_t kProgramNs = 16000;  // Word program time (x32)
+static constexpr uint64_t kEraseNs = 1000000;  // Shortened, the real sector erase is much longer
+static constexpr uint64_t kPollNs = 50;        // One fmc_state_get()
+
+uint32_t g_ctl;
+static uint8_t s_flash[kSize];
+static bool s_is_locked = true;
+static uint64_t s_now;        // ns
+static uint64_t s_busy_until; // ns
+static uint32_t s_words;
+static uint32_t s_fail_word = UINT32_MAX; // The program of this word fails with PGMERR
+static bool s_is_failed;
+static uint32_t s_polls;
+static uint32_t s_busy_polls; // Polls that found the FMC busy
+static uint32_t s_violations;
+static uint32_t s_erase_psz;
+static bool s_is_erase_failing; // The erase fails with OPERR
+
+static void Violation(const char* what, uint32_t address) {
+    printf("  violation: %s at 0x%08X\n", what, static_cast<unsigned>(address));
+    s_violations++;
+}
+
+void Word::operator=(uint32_t word) const {
+    if (s_is_locked) Violation("program while locked", address);
+    if ((g_ctl & FMC_CTL_PG) == 0) Violation("program without PG", address);
+    if ((g_ctl & FMC_CTL_PSZ) != CTL_PSZ_WORD) Violation("program size not x32", address);
+    if (s_now < s_busy_until) Violation("program while busy", address);
+    if ((address & 0x3) != 0) Violation("unaligned program", address);
+    if ((address < FLASH_BASE) || (address + 4 > FLASH_BASE + kSize)) {
+        Violation("program outside the flash", address);
+        return;
+    }
+
+    auto* cell = &s_flash[address - FLASH_BASE];
+    uint32_t current;
+    memcpy(&current, cell, 4);
+
+    if (current != 0xFFFFFFFF) Violation("program of a word that is not erased", address);
+
+    // Programming clears bits only
+    current &= word;
+    memcpy(cell, &current, 4);
+
+    s_is_failed = (s_words++ == s_fail_word);
+    s_busy_until = s_now + kProgramNs;
+}
+
+static void Reset() {
+    memset(s_flash, 0xFF, sizeof(s_flash));
+    g_ctl = 0;
+    s_is_locked = true;
+    s_now = 0;
+    s_busy_until = 0;
+    s_words = 0;
+    s_fail_word = UINT32_MAX;
+    s_is_failed = false;
+    s_polls = 0;
+    s_busy_polls = 0;
+    s_violations = 0;
+    s_is_erase_failing = false;
+}
+} // namespace flashmodel
+
+void fmc_unlock() {
+    flashmodel::s_is_locked = false;
+}
+
+void fmc_lock() {
+    flashmodel::s_is_locked = true;
+}
+
+void fmc_flag_clear([[maybe_unused]] uint32_t flag) {
+    flashmodel::s_is_failed = false;
+}
+
+fmc_state_enum fmc_state_get() {
+    using namespace flashmodel;
+    s_polls++;
+    s_now += kPollNs;
+
+    if ((g_ctl & FMC_CTL_START) != 0) {
+        g_ctl &= ~FMC_CTL_START;
+        const auto kSector = (g_ctl & FMC_CTL_SN) >> 3;
+        const auto kInfo = fmc_sector_info_get(FLASH_BASE + (kSector < 4 ? kSector * SIZE_16KB : kSector == 4 ? 4 * SIZE_16KB : (kSector - 4) * SIZE_128KB));
+        memset(&s_flash[kInfo.sector_start_addr - FLASH_BASE], 0xFF, kInfo.sector_size);
+        s_erase_psz = g_ctl & FMC_CTL_PSZ;
+        s_busy_until = s_now + kEraseNs;
+        s_is_failed = s_is_erase_failing;
+    }
+
+    if (s_now < s_busy_until) {
+        s_busy_polls++;
+        return FMC_BUSY;
+    }
+
+    if (s_is_failed) {
+        return s_is_erase_failing ? FMC_OPERR : FMC_PGMERR;
+    }
+
+    return FMC_READY;
+}
+
+/*
+ * Bank 0 of the GD32F4xx: sectors 0-3 are 16K, sector 4 is 64K, sectors 5-11 are 128K.
+ */
+fmc_sector_info_struct fmc_sector_info_get(uint32_t addr) {
+    fmc_sector_info_struct info;
+    const auto kOffset = addr - FLASH_BASE;
+
+    if ((addr < FLASH_BASE) || (kOffset >= flashmodel::kSize)) {
+        info.sector_name = FMC_WRONG_SECTOR_NAME;
+        info.sector_num = FMC_WRONG_SECTOR_NUM;
+        info.sector_size = FMC_INVALID_SIZE;
+        info.sector_start_addr = FMC_INVALID_ADDR;
+        info.sector_end_addr = FMC_INVALID_ADDR;
+        return info;
+    }
+
+    uint32_t sector;
+    uint32_t start;
+
+    if (kOffset < 4 * SIZE_16KB) {
+        sector = kOffset / SIZE_16KB;
+        start = sector * SIZE_16KB;
+        info.sector_size = SIZE_16KB;
+    } else if (kOffset < SIZE_128KB) {
+        sector = 4;
+        start = 4 * SIZE_16KB;
+        info.sector_size = SIZE_64KB;
+    } else {
+        sector = 4 + kOffset / SIZE_128KB;
+        start = (sector - 4) * SIZE_128KB;
+        info.sector_size = SIZE_128KB;
+    }
+
+    info.sector_name = sector;
+    info.sector_num = CTL_SN(sector);
+    info.sector_start_addr = FLASH_BASE + start;
+    info.sector_end_addr = FLASH_BASE + start + info.sector_size - 1;
+    return info;
+}
+
+/*
+ * The word-by-word path FlashCode is derived from: one word per Write() call, without staging.
+ */
+namespace reference {
+static bool s_is_busy;
+static uint32_t s_address;
+static uint32_t s_length;
+static const uint8_t* s_data;
+
+static void word_program_start() {
+    uint32_t data = 0xFFFFFFFF;
+    const auto kCount = s_length < 4 ? s_length : 4;
+
+    memcpy(&data, s_data, kCount);
+
+    FMC_CTL &= ~FMC_CTL_PSZ;
+    FMC_CTL |= (CTL_PSZ_WORD | FMC_CTL_PG);
+
+    REG32(s_address) = data;
+
+    s_data += kCount;
+    s_address += 4;
+    s_length -= kCount;
+}
+
+static bool Write(uint32_t offset, uint32_t length, const uint8_t* buffer, flashcode::Result& result) {
+    result = flashcode::Result::kOk;
+
+    if (!s_is_busy) {
+        s_address = offset + FLASH_BASE;
+        s_length = length;
+        s_data = buffer;
+
+        if (s_length == 0) {
+            return true;
+        }
+
+        fmc_unlock();
+        fmc_flag_clear(FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR | FMC_FLAG_PGSERR);
+        word_program_start();
+        s_is_busy = true;
+        return false;
+    }
+
+    const auto kState = fmc_state_get();
+
+    if (FMC_BUSY == kState) {
+        return false;
+    }
+
+    if ((FMC_READY != kState) || (s_length == 0)) {
+        FMC_CTL &= ~(FMC_CTL_SER | FMC_CTL_SN | FMC_CTL_PG);
+        fmc_lock();
+        if (FMC_READY != kState) {
+            result = flashcode::Result::kError;
+        }
+        s_is_busy = false;
+        return true;
+    }
+
+    word_program_start();
+    return false;
+}
+} // namespace reference
+
+namespace {
+struct Run {
+    flashcode::Result result;
+    uint64_t ns; // Until Write() returns true
+    uint32_t busy_polls;
+    uint32_t words;
+    uint32_t violations;
+};
+
+static uint8_t s_image[flashmodel::kSize];
+static uint32_t s_failures;
+
+template <typename F> Run Program(F write, uint32_t offset, uint32_t length, const uint8_t* data, uint32_t fail_word, uint64_t superloop_ns) {
+    flashmodel::Reset();
+    flashmodel::s_fail_word = fail_word;
+
+    Run run{};
+
+    while (!write(offset, length, data, run.result)) {
+        flashmodel::s_now += superloop_ns;
+    }
+
+    run.ns = flashmodel::s_now;
+    run.busy_polls = flashmodel::s_busy_polls;
+    run.words = flashmodel::s_words;
+    run.violations = flashmodel::s_violations;
+
+    if (!flashmodel::s_is_locked) {
+        puts("  the FMC is left unlocked");
+        run.violations++;
+    }
+
+    if ((FMC_CTL & FMC_CTL_PG) != 0) {
+        puts("  PG is left set");
+        run.violations++;
+    }
+
+    return run;
+}
+
+static void Check(bool condition, const char* what, uint32_t offset, uint32_t length) {
+    if (!condition) {
+        printf("FAIL: %s, offset=0x%X, length=%u\n", what, static_cast<unsigned>(offset), static_cast<unsigned>(length));
+        s_failures++;
+    }
+}
+
+static void Compare(uint32_t offset, uint32_t length, uint32_t fail_word, uint64_t superloop_ns) {
+    static uint8_t data[SIZE_128KB];
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+
+    FlashCode flashcode;
+    const auto kFlashCode = Program([&](uint32_t o, uint32_t l, const uint8_t* d, flashcode::Result& r) { return flashcode.Write(o, l, d, r); }, offset, length, data, fail_word, superloop_ns);
+    memcpy(s_image, flashmodel::s_flash, sizeof(s_image));
+
+    const auto kWord = Program(reference::Write, offset, length, data, fail_word, superloop_ns);
+
+    Check(kFlashCode.violations == 0, "FlashCode path FMC violations", offset, length);
+    Check(kWord.violations == 0, "word-by-word path FMC violations", offset, length);
+    Check(kFlashCode.result == kWord.result, "result differs", offset, length);
+    Check(kFlashCode.words == kWord.words, "number of programmed words differs", offset, length);
+    Check(memcmp(s_image, flashmodel::s_flash, sizeof(s_image)) == 0, "flash content differs", offset, length);
+    Check(kFlashCode.ns <= kWord.ns, "FlashCode path is slower", offset, length);
+    Check(kFlashCode.busy_polls <= kWord.busy_polls, "FlashCode path polls a busy FMC more", offset, length);
+
+    if (fail_word == UINT32_MAX) {
+        uint8_t expected[SIZE_128KB + 4];
+        memset(expected, 0xFF, sizeof(expected));
+        memcpy(expected, data, length);
+        Check(kFlashCode.result == flashcode::Result::kOk, "program failed", offset, length);
+        Check(memcmp(&s_image[offset], expected, (length + 3) & ~3U) == 0, "flash content is not the data", offset, length);
+        Check(s_image[offset + ((length + 3) & ~3U)] == 0xFF, "programmed past the end", offset, length);
+        Check((offset == 0) || (s_image[offset - 1] == 0xFF), "programmed before the start", offset, length);
+    } else {
+        Check(kFlashCode.result == flashcode::Result::kError, "the error is not reported", offset, length);
+        Check(kFlashCode.words == fail_word + 1, "programmed past the failing word", offset, length);
+    }
+
+    if ((length >= 1024) && (fail_word == UINT32_MAX)) {
+        printf("superloop=%2u us, length=%6u: program time FlashCode %7u us, word-by-word %7u us; busy polls FlashCode %5u, word-by-word %5u\n", static_cast<unsigned>(superloop_ns / 1000), static_cast<unsigned>(length), static_cast<unsigned>(kFlashCode.ns / 1000),
+               static_cast<unsigned>(kWord.ns / 1000), static_cast<unsigned>(kFlashCode.busy_polls), static_cast<unsigned>(kWord.busy_polls));
+    }
+}
+
+static void Erase() {
+    flashmodel::Reset();
+    memset(flashmodel::s_flash, 0x00, sizeof(flashmodel::s_flash));
+
+    FlashCode flashcode;
+    flashcode::Result result;
+    // Sectors 5 and 6, 128K each
+    while (!flashcode.Erase(0x20000, 0x40000, result)) {
+    }
+
+    Check(result == flashcode::Result::kOk, "erase failed", 0x20000, 0x40000);
+    Check(flashmodel::s_erase_psz == CTL_PSZ_WORD, "erase is not x32", 0x20000, 0x40000);
+    Check(flashmodel::s_is_locked, "the FMC is left unlocked after an erase", 0x20000, 0x40000);
+
+    auto is_erased = true;
+    for (uint32_t i = 0x20000; i < 0x60000; i++) {
+        is_erased = is_erased && (flashmodel::s_flash[i] == 0xFF);
+    }
+
+    Check(is_erased, "sectors not erased", 0x20000, 0x40000);
+    Check((flashmodel::s_flash[0x1FFFF] == 0x00) && (flashmodel::s_flash[0x60000] == 0x00), "erased outside the sectors", 0x20000, 0x40000);
+}
+
+/*
+ * A Write() while an erase is running finishes the erase first, a failed erase fails the write.
+ */
+static void EraseFailsWrite() {
+    flashmodel::Reset();
+    flashmodel::s_is_erase_failing = true;
+
+    FlashCode flashcode;
+    flashcode::Result result;
+
+    Check(!flashcode.Erase(0x20000, SIZE_128KB, result), "erase is not started", 0x20000, SIZE_128KB);
+
+    static constexpr uint8_t kData[4] = {0x12, 0x34, 0x56, 0x78};
+    uint32_t calls = 0;
+
+    while (!flashcode.Write(0x40000, sizeof(kData), kData, result)) {
+        if (++calls > 2 * (flashmodel::kEraseNs / flashmodel::kPollNs)) {
+            break;
+        }
+    }
+
+    Check(result == flashcode::Result::kError, "the erase error is not returned by Write", 0x40000, sizeof(kData));
+    Check(flashmodel::s_words == 0, "written after a failed erase", 0x40000, sizeof(kData));
+    Check(flashmodel::s_is_locked, "the FMC is left unlocked after a failed erase", 0x40000, sizeof(kData));
+}
+} // namespace
+
+// The FlashCode constructor and GetName() live in the platform file, not needed here
+FlashCode::FlashCode() {}
+FlashCode::~FlashCode() {}
+
+int main() {
+    static constexpr uint32_t kLengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 31, 32, 33, 35, 36, 63, 64, 65, 512, 515, 1024, 1468, 16384, SIZE_128KB};
+    static constexpr uint32_t kOffsets[] = {0x8000, 0x20000, 0x60000};
+
+    // The superloop between two polls: tighter than, close to, and much longer than a word program
+    static constexpr uint64_t kSuperloopNs[] = {2000, 20000, 80000};
+
+    srand(1);
+
+    for (const auto kSuperloop : kSuperloopNs) {
+        for (const auto kOffset : kOffsets) {
+            for (const auto kLength : kLengths) {
+                Compare(kOffset, kLength, UINT32_MAX, kSuperloop);
+            }
+        }
+    }
+
+    // A program error stops both paths at the same word
+    static constexpr uint32_t kFailWords[] = {0, 1, 7, 8, 9, 17, 255};
+    for (const auto kSuperloop : kSuperloopNs) {
+        for (const auto kFailWord : kFailWords) {
+            Compare(0x60000, 1024, kFailWord, kSuperloop);
+        }
+    }
+
+    Erase();
+    EraseFailsWrite();
+
+    if (s_failures != 0) {
+        printf("%u failures\n", static_cast<unsigned>(s_failures));
+        return EXIT_FAILURE;
+    }
+
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+#
+# Host test of the GD32F4xx flash code against a model of the FMC.
+# Usage: ./run.sh
+#
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+root="$dir/../../../.."
+out="${TMPDIR:-/tmp}/flashcode-flashmodel"
+
+${CXX:-g++} -std=c++20 -O1 -Wall -Wextra \
+	-I"$dir/stub" -I"$root/lib-flashcode/include" -I"$root/lib-flashcode/src/gd32/f4xx" -I"$root/common/include" \
+	"$dir/flashmodel.cpp" "$root/lib-flashcode/src/gd32/f4xx/flashcode.cpp" -o "$out"
+
+"$out"
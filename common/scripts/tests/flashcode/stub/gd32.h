@@ -0,0 +1,73 @@
+/**
+ * @file gd32.h
+ *
+ * Host stub: the FMC registers and functions used by lib-flashcode/src/gd32/f4xx/flashcode.cpp,
+ * backed by the flash model in flashmodel.cpp.
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GD32_H_
+#define GD32_H_
+
+#include <cstdint>
+
+#include "gd32f4xx.h"
+
+#define BIT(x) (1U << (x))
+#define BITS(start, end) ((0xFFFFFFFFU << (start)) & (0xFFFFFFFFU >> (31U - (end))))
+
+#define FMC_CTL_PG BIT(0)
+#define FMC_CTL_SER BIT(1)
+#define FMC_CTL_SN BITS(3, 7)
+#define FMC_CTL_PSZ BITS(8, 9)
+#define FMC_CTL_START BIT(16)
+#define CTL_SN(regval) (BITS(3, 7) & (static_cast<uint32_t>(regval) << 3U))
+#define CTL_PSZ(regval) (BITS(8, 9) & (static_cast<uint32_t>(regval) << 8U))
+#define CTL_PSZ_WORD CTL_PSZ(2)
+
+#define FMC_FLAG_END BIT(0)
+#define FMC_FLAG_OPERR BIT(1)
+#define FMC_FLAG_WPERR BIT(4)
+#define FMC_FLAG_PGMERR BIT(6)
+#define FMC_FLAG_PGSERR BIT(7)
+
+typedef enum { FMC_READY = 0, FMC_BUSY, FMC_RDDERR, FMC_PGSERR, FMC_PGMERR, FMC_WPERR, FMC_OPERR, FMC_TOERR } fmc_state_enum;
+
+namespace flashmodel {
+extern uint32_t g_ctl;
+
+// A program access to the flash, REG32(address) = word
+struct Word {
+    uint32_t address;
+    void operator=(uint32_t word) const;
+};
+} // namespace flashmodel
+
+#define FMC_CTL (flashmodel::g_ctl)
+#define REG32(addr) (flashmodel::Word{static_cast<uint32_t>(addr)})
+
+void fmc_unlock();
+void fmc_lock();
+void fmc_flag_clear(uint32_t flag);
+fmc_state_enum fmc_state_get();
+
+#endif // GD32_H_
@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Host micro-benchmark of the UDP port lookup, packets/s against the number of bound ports.
+# Usage: ./run.sh [UDP_MAX_PORTS_ALLOWED...]
+#
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+root="$dir/../../../.."
+out="${TMPDIR:-/tmp}/udpbench"
+
+# The GD32 branch of net_config.h takes UDP_MAX_PORTS_ALLOWED from the command line
+for ports in ${@:-3 8 32}; do
+	${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -U__linux__ -Ulinux -U__linux -DGD32 -DUDP_MAX_PORTS_ALLOWED="$ports" -DUDP_MAX_COPY_PORTS=4 \
+		-I"$dir/stub" -I"$root/lib-network/include" -I"$root/lib-network/config" -I"$root/lib-network/src" -I"$root/lib-network/src/core" -I"$root/common/include" \
+		"$dir/udpbench.cpp" "$root/lib-network/src/core/udp.cpp" -o "$out"
+	"$out"
+done
@@ -0,0 +1,194 @@
+/**
+ * @file udpbench.cpp
+ *
+ * Host micro-benchmark of network::udp::Input, packets/s against the number of bound ports.
+ * Half of the packets are for a bound port, the other half for an unbound port.
+ * The linear column is the port scan that Input did before the hashed lookup.
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "network_private.h"
+#include "network_udp.h"
+#include "core/netif.h"
+#include "core/ip4/arp.h"
+#include "core/protocol/udp.h"
+
+// The platform symbols udp.cpp links against
+namespace emac::eth {
+static uint32_t s_freed;
+uint8_t* SendReserve() {
+    return nullptr;
+}
+void SendCommit(uint32_t) {}
+void FreePkt() {
+    s_freed++;
+}
+} // namespace emac::eth
+
+namespace netif::global {
+struct Netif netif_default;
+} // namespace netif::global
+
+namespace network {
+namespace global {
+uint32_t broadcast_mask;
+} // namespace global
+namespace arp {
+void Send(void*, const uint32_t, uint32_t) {}
+} // namespace arp
+} // namespace network
+
+namespace {
+constexpr uint32_t kPackets = 256;
+network::udp::Header s_packets[kPackets];
+uint32_t s_received;
+
+void Callback(const uint8_t*, uint32_t, uint32_t, uint16_t) {
+    s_received++;
+}
+
+// The linear scan that network::udp::Input replaced
+struct PortInfo {
+    network::udp::UdpCallbackFunctionPtr callback;
+    void* data;
+    uint16_t port;
+};
+
+PortInfo s_linear[UDP_MAX_PORTS_ALLOWED];
+
+void LinearInput(const network::udp::Header* udp) {
+    const auto kDestinationPort = __builtin_bswap16(udp->udp.destination_port);
+
+    for (uint32_t port_index = 0; port_index < UDP_MAX_PORTS_ALLOWED; port_index++) {
+        const auto& info = s_linear[port_index];
+
+        if (info.port == kDestinationPort) {
+            const auto kDataLength = __builtin_bswap16(udp->udp.len) - network::udp::kHeaderSize;
+            info.callback(udp->udp.data, kDataLength, 0, __builtin_bswap16(udp->udp.source_port));
+            emac::eth::FreePkt();
+            return;
+        }
+    }
+
+    emac::eth::FreePkt();
+}
+
+template <typename F> double PacketsPerSecond(F input) {
+    uint32_t rounds = 0;
+    const auto kStart = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed;
+
+    do {
+        for (const auto& packet : s_packets) {
+            input(&packet);
+        }
+        rounds++;
+        elapsed = std::chrono::steady_clock::now() - kStart;
+    } while (elapsed.count() < 0.2);
+
+    return (static_cast<double>(kPackets) * rounds) / elapsed.count();
+}
+
+uint16_t Port(uint32_t i) {
+    // Spread like real bindings: well known ports and ephemeral ones
+    static constexpr uint16_t kKnown[] = {69, 10501, 6454, 5568, 319, 320, 123, 5353};
+    return (i < sizeof(kKnown) / sizeof(kKnown[0])) ? kKnown[i] : static_cast<uint16_t>(49152 + (i * 7919) % 16384);
+}
+} // namespace
+
+int main() {
+    static constexpr uint32_t kBound[] = {1, 2, 4, 8, 16, 32, 64};
+    uint32_t failures = 0;
+
+    srand(1);
+
+    printf("UDP_MAX_PORTS_ALLOWED=%u\n", static_cast<unsigned>(UDP_MAX_PORTS_ALLOWED));
+    printf("%6s %14s %14s\n", "bound", "linear", "hashed");
+
+    for (const auto kCount : kBound) {
+        if (kCount > UDP_MAX_PORTS_ALLOWED) {
+            break;
+        }
+
+        memset(s_linear, 0, sizeof(s_linear));
+
+        for (uint32_t i = 0; i < kCount; i++) {
+            network::udp::Begin(Port(i), Callback, network::udp::Mode::kZeroCopy);
+            s_linear[i] = {Callback, nullptr, Port(i)};
+        }
+
+        uint32_t expected = 0;
+
+        for (uint32_t i = 0; i < kPackets; i++) {
+            auto& packet = s_packets[i];
+            uint16_t port;
+
+            if ((i & 1) == 0) {
+                port = Port(static_cast<uint32_t>(rand()) % kCount);
+                expected++;
+            } else {
+                // Not bound: above the ephemeral ports in use
+                do {
+                    port = static_cast<uint16_t>(1024 + static_cast<uint32_t>(rand()) % 40000);
+                } while ((port == 5568) || (port == 6454) || (port == 10501));
+            }
+
+            packet.udp.destination_port = __builtin_bswap16(port);
+            packet.udp.source_port = __builtin_bswap16(4096);
+            packet.udp.len = __builtin_bswap16(static_cast<uint16_t>(network::udp::kHeaderSize + 16));
+        }
+
+        // Both deliver the same packets, every packet is freed
+        s_received = 0;
+        emac::eth::s_freed = 0;
+        for (const auto& packet : s_packets) {
+            network::udp::Input(&packet);
+        }
+
+        if ((s_received != expected) || (emac::eth::s_freed != kPackets)) {
+            printf("FAIL: bound=%u, received %u of %u\n", static_cast<unsigned>(kCount), static_cast<unsigned>(s_received), static_cast<unsigned>(expected));
+            failures++;
+        }
+
+        const auto kLinear = PacketsPerSecond(LinearInput);
+        const auto kHashed = PacketsPerSecond(network::udp::Input);
+
+        printf("%6u %10.2f M/s %10.2f M/s\n", static_cast<unsigned>(kCount), kLinear / 1e6, kHashed / 1e6);
+
+        for (uint32_t i = 0; i < kCount; i++) {
+            network::udp::End(Port(i));
+        }
+    }
+
+    if (failures != 0) {
+        return EXIT_FAILURE;
+    }
+
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
@@ -162,7 +162,8 @@ $(BUILD)main.elf: \
 
 # Convert the ELF image into a binary image. RAM-only sections are
 # removed because they are initialized at runtime rather than stored
-# in flash.
+# in flash. The image size and CRC32 are stamped into the reserved
+# vector table entries, checked by the bootloader while it is received.
 $(TARGET): $(BUILD)main.elf
 	$(PREFIX)objcopy $< \
 		-O binary \
@@ -172,5 +173,6 @@ $(TARGET): $(BUILD)main.elf
 		--remove-section=.sram2* \
 		--remove-section=.ramadd* \
 		--remove-section=.bkpsram*
+	python3 ../common/scripts/gd32/image_crc.py $@
 
 $(foreach bdir,$(SRCDIR),$(eval $(call compile-objects,$(bdir))))
@@ -65,6 +65,38 @@ OF SUCH DAMAGE.
 #include "gd32f4xx_misc.h"
 #endif
 
+/*
+ * EMAC descriptor rings, the build options are
+ * CONFIG_EMAC_RXBUF_NUM, CONFIG_EMAC_TXBUF_NUM and CONFIG_EMAC_BUF_SIZE.
+ * The vendor driver (lib-gd32) and lib-network must see the same values, hence here.
+ * The defaults: GD32F450VI and GD32F470 have 16 Rx and 8 Tx buffers of 1524 bytes (about 37K)
+ * in RAMADD, which they share with .bss and .ramadd. The heap is in TCMSRAM.
+ * The linker script asserts that .enet, .bss and .ramadd fit in the 256K RAMADD.
+ * The others keep the vendor default of 5.
+ */
+#if defined (CONFIG_EMAC_RXBUF_NUM)
+#define ENET_RXBUF_NUM                   (CONFIG_EMAC_RXBUF_NUM)
+#elif defined (GD32F450VI) || defined (GD32F470)
+#define ENET_RXBUF_NUM                   16U
+#endif
+
+#if defined (CONFIG_EMAC_TXBUF_NUM)
+#define ENET_TXBUF_NUM                   (CONFIG_EMAC_TXBUF_NUM)
+#elif defined (GD32F450VI) || defined (GD32F470)
+#define ENET_TXBUF_NUM                   8U
+#endif
+
+#if defined (CONFIG_EMAC_BUF_SIZE)
+#define ENET_RXBUF_SIZE                  (CONFIG_EMAC_BUF_SIZE)
+#define ENET_TXBUF_SIZE                  (CONFIG_EMAC_BUF_SIZE)
+#endif
+
+/*
+ * The descriptors and buffers are zero initialized data in section .bss.enet
+ * The linker script places it in SRAM reachable by the ENET DMA, without it .bss gets it.
+ */
+#define ENET_DMA_SECTION                 __attribute__((section(".bss.enet")))
+
 #if defined (GD32F450)
 #include "gd32f4xx_enet.h"
 #include "gd32f4xx_exmc.h"
@@ -0,0 +1,90 @@
+/**
+ * @file crc32.cpp
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * zlib compatible crc32 with the GD32 CRC calculation unit (CONFIG_HAVE_CRC32_HW).
+ *
+ * The unit: polynomial 0x04C11DB7, reset value 0xFFFFFFFF, 32-bit input,
+ * MSB first and no output inversion. The zlib CRC is bit reflected,
+ * so each input word and the result are bit reversed (RBIT).
+ * The reversal is per word, which a DMA transfer cannot do: the unit is fed by the CPU,
+ * one word each ~4 cycles. That is well below the flash read time.
+ *
+ * The unit has no initial value register. A running crc is loaded by first feeding
+ * the word that takes the reset value 0xFFFFFFFF to the wanted state.
+ * The 0 to 3 trailing bytes are done in software.
+ */
+
+#pragma GCC push_options
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+#include <cstring>
+
+#include "gd32.h"
+
+namespace {
+constexpr uint32_t kPolynomial = 0x04C11DB7;
+
+/*
+ * Reverse of the 32 shifts the unit does for one input word.
+ */
+uint32_t Unshift(uint32_t state) {
+    for (uint32_t k = 0; k < 32; k++) {
+        state = (state & 1) ? ((state ^ kPolynomial) >> 1) | 0x80000000 : state >> 1;
+    }
+
+    return state;
+}
+} // namespace
+
+uint32_t crc32(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    CRC_CTL = CRC_CTL_RST;
+
+    if (crc != 0) {
+        CRC_DATA = Unshift(__RBIT(crc ^ 0xffffffff)) ^ 0xffffffff;
+    }
+
+    for (auto words = len / 4; words != 0; words--) {
+        uint32_t data;
+        memcpy(&data, buf, 4); // Unaligned access is supported
+        CRC_DATA = __RBIT(data);
+        buf += 4;
+    }
+
+    crc = __RBIT(CRC_DATA);
+
+    // And the last few bytes, reflected
+    for (len &= 3; len != 0; len--) {
+        crc ^= *buf++;
+        for (uint32_t k = 0; k < 8; k++) {
+            crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+        }
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+#pragma GCC pop_options
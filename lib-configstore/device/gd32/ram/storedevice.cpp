@@ -61,6 +61,10 @@ uint32_t StoreDevice::GetSectorSize() const {
     return kFlashSectorSize;
 }
 
+uint32_t StoreDevice::GetSectorSize([[maybe_unused]] uint32_t offset) const {
+    return GetSectorSize();
+}
+
 bool StoreDevice::Read(__attribute__((unused)) uint32_t offset, __attribute__((unused)) uint32_t length, __attribute__((unused)) uint8_t* buffer, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
     assert((offset + length) <= BSRAM_SIZE);
@@ -54,6 +54,10 @@ uint32_t StoreDevice::GetSectorSize() const {
     return FlashCode::GetSectorSize();
 }
 
+uint32_t StoreDevice::GetSectorSize(uint32_t offset) const {
+    return FlashCode::GetSectorSize(offset);
+}
+
 bool StoreDevice::Read(uint32_t offset, uint32_t length, uint8_t* buffer, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
 
@@ -72,6 +72,10 @@ uint32_t StoreDevice::GetSectorSize() const {
     return storedevice::kFlashSectorSize;
 }
 
+uint32_t StoreDevice::GetSectorSize([[maybe_unused]] uint32_t offset) const {
+    return GetSectorSize();
+}
+
 bool StoreDevice::Read(uint32_t offset, uint32_t length, uint8_t* buffer, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
     assert((offset + length) <= storedevice::ROM_SIZE);
@@ -29,11 +29,93 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <algorithm>
+#include <cassert>
 
 #include "configstoredevice.h"
 #include "spi/spi_flash.h"
 #include "configstore_debug.h"
 
+/*
+ * The SPI flash is accessed non-blocking, a call starts the next chunk and returns false.
+ * The caller polls with the same arguments until true is returned.
+ * A call for another operation waits for the one in progress to complete.
+ */
+namespace {
+enum class Operation { kNone, kRead, kErase, kWrite };
+
+struct Transfer {
+    Operation operation;
+    uint32_t offset;
+    uint32_t length;
+    uint8_t* buffer;
+    uint32_t count; ///< Bytes of the chunks started
+};
+
+constexpr uint32_t kReadChunkSize = 4096; ///< Never crossing the 16MB boundary
+} // namespace
+
+static Transfer s_transfer;
+
+static bool TransferNext() {
+    if (spi_flash_is_busy()) {
+        return false;
+    }
+
+    if (s_transfer.count == s_transfer.length) {
+        s_transfer.operation = Operation::kNone;
+        return true;
+    }
+
+    const auto kOffset = s_transfer.offset + s_transfer.count;
+    const auto kRemaining = s_transfer.length - s_transfer.count;
+    uint32_t chunk;
+
+    switch (s_transfer.operation) {
+        case Operation::kRead:
+            chunk = std::min(kRemaining, kReadChunkSize - (kOffset % kReadChunkSize));
+            spi_flash_read_start(kOffset, chunk, &s_transfer.buffer[s_transfer.count]);
+            break;
+        case Operation::kErase:
+            chunk = spi::flash::SECTOR_SIZE;
+            spi_flash_sector_erase_start(kOffset);
+            break;
+        case Operation::kWrite:
+            chunk = std::min(kRemaining, spi::flash::PAGE_SIZE - (kOffset % spi::flash::PAGE_SIZE));
+            spi_flash_page_program_start(kOffset, chunk, &s_transfer.buffer[s_transfer.count]);
+            break;
+        default:
+            assert(0);
+            __builtin_unreachable();
+            break;
+    }
+
+    s_transfer.count += chunk;
+    return false;
+}
+
+static bool TransferPoll(Operation operation, uint32_t offset, uint32_t length, uint8_t* buffer) {
+    if (s_transfer.operation != Operation::kNone) {
+        const auto kIsSame = (s_transfer.operation == operation) && (s_transfer.offset == offset) && (s_transfer.length == length) && (s_transfer.buffer == buffer);
+
+        if (kIsSame) {
+            return TransferNext();
+        }
+
+        if (!TransferNext()) {
+            return false;
+        }
+    }
+
+    s_transfer.operation = operation;
+    s_transfer.offset = offset;
+    s_transfer.length = length;
+    s_transfer.buffer = buffer;
+    s_transfer.count = 0;
+
+    return TransferNext();
+}
+
 StoreDevice::StoreDevice() {
     CONFIGSTORE_DEBUG_ENTRY();
 
@@ -61,32 +143,45 @@ uint32_t StoreDevice::GetSectorSize() const {
     return spi_flash_get_sector_size();
 }
 
+uint32_t StoreDevice::GetSectorSize([[maybe_unused]] uint32_t offset) const {
+    return GetSectorSize();
+}
+
 bool StoreDevice::Read(uint32_t offset, uint32_t length, uint8_t* buffer, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
 
-    result = spi_flash_cmd_read_fast(offset, length, buffer) ? storedevice::Result::kOk : storedevice::Result::kError;
+    result = storedevice::Result::kOk;
+    const auto kIsDone = TransferPoll(Operation::kRead, offset, length, buffer);
 
-    CONFIGSTORE_DEBUG_PRINTF("result=%d", static_cast<int>(result));
+    CONFIGSTORE_DEBUG_PRINTF("kIsDone=%d", static_cast<int>(kIsDone));
     CONFIGSTORE_DEBUG_EXIT();
-    return true;
+    return kIsDone;
 }
 
 bool StoreDevice::Erase(uint32_t offset, uint32_t length, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
 
-    result = spi_flash_cmd_erase(offset, length) ? storedevice::Result::kOk : storedevice::Result::kError;
+    if ((offset % spi::flash::SECTOR_SIZE) || (length % spi::flash::SECTOR_SIZE)) {
+        result = storedevice::Result::kError;
+        CONFIGSTORE_DEBUG_EXIT();
+        return true;
+    }
+
+    result = storedevice::Result::kOk;
+    const auto kIsDone = TransferPoll(Operation::kErase, offset, length, nullptr);
 
-    CONFIGSTORE_DEBUG_PRINTF("result=%d", static_cast<int>(result));
+    CONFIGSTORE_DEBUG_PRINTF("kIsDone=%d", static_cast<int>(kIsDone));
     CONFIGSTORE_DEBUG_EXIT();
-    return true;
+    return kIsDone;
 }
 
 bool StoreDevice::Write(uint32_t offset, uint32_t length, const uint8_t* buffer, storedevice::Result& result) {
     CONFIGSTORE_DEBUG_ENTRY();
 
-    result = spi_flash_cmd_write_multi(offset, length, buffer) ? storedevice::Result::kOk : storedevice::Result::kError;
+    result = storedevice::Result::kOk;
+    const auto kIsDone = TransferPoll(Operation::kWrite, offset, length, const_cast<uint8_t*>(buffer));
 
-    CONFIGSTORE_DEBUG_PRINTF("result=%d", static_cast<int>(result));
+    CONFIGSTORE_DEBUG_PRINTF("kIsDone=%d", static_cast<int>(kIsDone));
     CONFIGSTORE_DEBUG_EXIT();
-    return true;
+    return kIsDone;
 }
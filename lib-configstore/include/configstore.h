@@ -27,9 +27,12 @@
 #define CONFIGSTORE_H_
 
 #include <cstdint>
+#include <cstddef>
 #include <cstring>
 #include <cassert>
 
+#include <zlib.h>
+
 #include "configstoredevice.h"
 #include "configurationstore.h"
 #include "global.h"
@@ -42,6 +45,59 @@ class ConfigStore : StoreDevice {
     static constexpr uint8_t kVersion[configurationstore::kVersionSize] = {0, 1};
     static_assert(sizeof(ConfigurationStore) <= kStoreSize);
 
+    /*
+     * Double buffered store: two copies at the end of the device, each with a sequence number and a CRC32.
+     * A write goes to the copy not in use, the copy in use is valid until the new one is complete.
+     * At boot the two headers are read, the newest copy with a valid CRC32 is loaded.
+     * Each copy is at the end of its own erase units, the second copy is where the store is without one.
+     * Used without CONFIG_STORE_JOURNAL, and with it when the journal is refused.
+     */
+    static constexpr uint32_t kCopies = 2;
+
+    struct CopyHeader {
+        uint8_t magic_number[configurationstore::kMagicNumberSize];
+        uint8_t version[configurationstore::kVersionSize];
+        uint8_t reserved[2];
+        uint32_t crc;
+        uint32_t sequence;
+    };
+    static_assert(sizeof(CopyHeader) == offsetof(ConfigurationStore, global));
+
+#if defined(CONFIG_STORE_JOURNAL)
+    /*
+     * Journaled store: the device region is kJournalSegments segments.
+     * A segment is a header, a snapshot of the store and the records appended after it.
+     * A record holds the changed blocks only, a Commit is a page program instead of an erase.
+     * When a segment is full the store is compacted: the next segment is erased,
+     * the snapshot is written, then its header. Until then the current segment is valid.
+     * The segments are used in turn, the erases are spread over the region.
+     * Each segment has its own erase units, placed before the erase units of the store without a journal.
+     * When a segment does not fit in kJournalSegmentSizeMax (GD32F4xx internal flash: 128K sectors),
+     * the journal is refused and the store is double buffered, as without the journal.
+     */
+    static constexpr uint32_t kJournalSegments = 4;
+    static constexpr uint32_t kJournalMagic = 0x4A567641; // "AvVJ"
+    static constexpr uint32_t kJournalBlockSize = 32;     ///< Granularity of the change tracking
+    static constexpr uint32_t kJournalBlocks = (sizeof(ConfigurationStore) + kJournalBlockSize - 1) / kJournalBlockSize;
+    static constexpr uint32_t kJournalRecordDataMax = 256;
+    static constexpr uint32_t kJournalSegmentSizeMax = 8 * kStoreSize; ///< Larger erase units refuse the journal
+    static constexpr uint32_t kJournalNone = kJournalSegments;
+    static_assert((sizeof(ConfigurationStore) % 4) == 0);
+
+    struct JournalSegment {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t size;
+        uint32_t crc;
+    };
+
+    struct JournalRecord {
+        uint16_t offset; ///< 0xFFFF: erased, the end of the journal
+        uint16_t length;
+        uint32_t crc; ///< Over offset, length and the data
+    };
+#endif
+
     enum class State {
         kIdle,           //
         kChanged,        //
@@ -49,17 +105,21 @@ class ConfigStore : StoreDevice {
         kErasing,        //
         kErased,         //
         kErasedWaiting,  //
-        kWriting         //
+        kWriting,        //
+        kCommitting,     //
+        kAppending       //
     };
 
-    [[maybe_unused]] static constexpr char kStateNames[7][16] = {
+    [[maybe_unused]] static constexpr char kStateNames[9][16] = {
         "IDLE",            //
         "CHANGED",         //
         "CHANGED_WAITING", //
         "ERASING",         //
         "ERASED",          //
         "ERASED_WAITING",  //
-        "WRITING"          //
+        "WRITING",         //
+        "COMMITTING",      //
+        "APPENDING"        //
     };
 
    public:
@@ -76,25 +136,11 @@ class ConfigStore : StoreDevice {
         CONFIGSTORE_DEBUG_PRINTF("s_have_device=%u", s_have_device);
 
         if (s_have_device) {
-            assert(kStoreSize <= StoreDevice::GetSize());
-
-            const auto kEraseSize = StoreDevice::GetSectorSize();
-            assert(kEraseSize <= kStoreSize);
-
-            const auto kSectors = kStoreSize / kEraseSize;
-
-            CONFIGSTORE_DEBUG_PRINTF("kStoreSize=%u, kEraseSize=%u, kSectors=%u", static_cast<unsigned>(kStoreSize), static_cast<unsigned>(kEraseSize), static_cast<unsigned>(kSectors));
-
-            assert((kSectors * kEraseSize) <= StoreDevice::GetSize());
-
-            s_start_address = StoreDevice::GetSize() - (kSectors * kEraseSize);
-
-            CONFIGSTORE_DEBUG_PRINTF("s_start_address=%p", reinterpret_cast<void*>(s_start_address));
-
-            storedevice::Result result;
-            while (!StoreDevice::Read(s_start_address, kStoreSize, reinterpret_cast<uint8_t*>(&s_store), result)) {
-            }
-            assert(result == storedevice::Result::kOk);
+#if defined(CONFIG_STORE_JOURNAL)
+            JournalLoad();
+#else
+            CopyLoad();
+#endif
         }
 
         auto* store = GetStore();
@@ -141,7 +187,7 @@ class ConfigStore : StoreDevice {
 
         if (__builtin_memcmp(destination, source, sizeof(TMember)) != 0) {
             __builtin_memcpy(destination, source, sizeof(TMember));
-            SetStatusChanged();
+            SetStatusChanged(destination, sizeof(TMember));
         }
     }
 
@@ -312,7 +358,7 @@ class ConfigStore : StoreDevice {
 
         if (array[index] != value) {
             array[index] = value;
-            SetStatusChanged();
+            SetStatusChanged(&array[index], sizeof(T));
         }
     }
 
@@ -332,7 +378,7 @@ class ConfigStore : StoreDevice {
         if (__builtin_memcmp(labels[index], src, length) != 0) {
             memset(labels[index], 0, N);
             memcpy(labels[index], src, length);
-            SetStatusChanged();
+            SetStatusChanged(labels[index], N);
         }
     }
 
@@ -344,7 +390,7 @@ class ConfigStore : StoreDevice {
 
         if (array[index] != value) {
             array[index] = value;
-            SetStatusChanged();
+            SetStatusChanged(&array[index], sizeof(T));
         }
     }
 
@@ -388,7 +434,7 @@ class ConfigStore : StoreDevice {
 
         if (__builtin_memcmp(&dest, src, sizeof(common::store::l6470dmx::SparkFun)) != 0) {
             __builtin_memcpy(&dest, src, sizeof(common::store::l6470dmx::SparkFun));
-            SetStatusChanged();
+            SetStatusChanged(&dest, sizeof(common::store::l6470dmx::SparkFun));
         }
     }
 
@@ -398,7 +444,7 @@ class ConfigStore : StoreDevice {
         auto& ref = GetStore()->dmx_l6470.store[index].spark_fun;
         if (__builtin_memcmp(&ref, src, sizeof(common::store::l6470dmx::SparkFun)) != 0) {
             __builtin_memcpy(&ref, src, sizeof(common::store::l6470dmx::SparkFun));
-            SetStatusChanged();
+            SetStatusChanged(&ref, sizeof(common::store::l6470dmx::SparkFun));
         }
     }
 
@@ -409,7 +455,7 @@ class ConfigStore : StoreDevice {
         auto& ref = GetStore()->dmx_l6470.store[index].mode;
         if (__builtin_memcmp(&ref, src, sizeof(common::store::l6470dmx::Mode)) != 0) {
             __builtin_memcpy(&ref, src, sizeof(common::store::l6470dmx::Mode));
-            SetStatusChanged();
+            SetStatusChanged(&ref, sizeof(common::store::l6470dmx::Mode));
         }
     }
 
@@ -419,7 +465,7 @@ class ConfigStore : StoreDevice {
         auto& ref = GetStore()->dmx_l6470.store[index].l6470;
         if (__builtin_memcmp(&ref, src, sizeof(common::store::l6470dmx::L6470)) != 0) {
             __builtin_memcpy(&ref, src, sizeof(common::store::l6470dmx::L6470));
-            SetStatusChanged();
+            SetStatusChanged(&ref, sizeof(common::store::l6470dmx::L6470));
         }
     }
 
@@ -429,7 +475,7 @@ class ConfigStore : StoreDevice {
         auto& ref = GetStore()->dmx_l6470.store[index].motor;
         if (__builtin_memcmp(&ref, src, sizeof(common::store::l6470dmx::Motor)) != 0) {
             __builtin_memcpy(&ref, src, sizeof(common::store::l6470dmx::Motor));
-            SetStatusChanged();
+            SetStatusChanged(&ref, sizeof(common::store::l6470dmx::Motor));
         }
     }
 
@@ -443,6 +489,12 @@ class ConfigStore : StoreDevice {
         return (GetStore()->dmx_l6470.store[index].motor).*field;
     }
 
+    /**
+     * The raw store block, as it is (or will be) in the store device.
+     */
+    static const uint8_t* GetRaw() { return s_store; }
+    static constexpr uint32_t GetRawSize() { return kStoreSize; }
+
     static ConfigStore& Instance() {
         assert(s_this != nullptr);
         return *s_this;
@@ -458,7 +510,7 @@ class ConfigStore : StoreDevice {
 
         if (__builtin_memcmp(dest, &value, sizeof(TField)) != 0) {
             __builtin_memcpy(dest, &value, sizeof(TField));
-            SetStatusChanged();
+            SetStatusChanged(dest, sizeof(TField));
         }
     }
 
@@ -474,11 +526,25 @@ class ConfigStore : StoreDevice {
         if (__builtin_memcmp(dest, src, length * sizeof(TArray)) != 0) {
             memset(dest, 0, sizeof(TArray) * N);
             memcpy(dest, src, length * sizeof(TArray));
-            SetStatusChanged();
+            SetStatusChanged(dest, sizeof(TArray) * N);
         }
     }
 
+    /*
+     * The whole store has changed.
+     */
     void SetStatusChanged() {
+#if defined(CONFIG_STORE_JOURNAL)
+        s_journal_compact = true;
+#endif
+        s_state = State::kChanged;
+        TimerStart();
+    }
+
+    void SetStatusChanged([[maybe_unused]] const void* address, [[maybe_unused]] uint32_t size) {
+#if defined(CONFIG_STORE_JOURNAL)
+        JournalMark(address, size);
+#endif
         s_state = State::kChanged;
         TimerStart();
     }
@@ -538,12 +604,24 @@ class ConfigStore : StoreDevice {
                 s_state = State::kChangedWaiting;
                 return true;
             case State::kChangedWaiting:
+#if defined(CONFIG_STORE_JOURNAL)
+                if (!s_journal_compact) {
+                    s_state = State::kAppending;
+                    return true;
+                }
+                s_journal_record_size = 0; // The snapshot has it
+#endif
                 s_state = State::kErasing;
                 return true;
                 break;
             case State::kErasing: {
                 storedevice::Result result;
-                if (StoreDevice::Erase(s_start_address, kStoreSize, result)) {
+#if defined(CONFIG_STORE_JOURNAL)
+                const auto kIsErased = s_journal_is_refused ? StoreDevice::Erase(CopyAddress(CopyNext()), kStoreSize, result) : StoreDevice::Erase(JournalAddress(JournalNext()), JournalSize(JournalNext()), result);
+#else
+                const auto kIsErased = StoreDevice::Erase(CopyAddress(CopyNext()), kStoreSize, result);
+#endif
+                if (kIsErased) {
                     s_state = State::kErasedWaiting;
                 }
                 assert(result == storedevice::Result::kOk);
@@ -555,18 +633,60 @@ class ConfigStore : StoreDevice {
                 break;
             case State::kErased:
                 s_state = State::kWriting;
+#if defined(CONFIG_STORE_JOURNAL)
+                if (s_journal_is_refused) {
+                    CopySeal();
+                }
+#else
+                CopySeal();
+#endif
                 SoftwareTimerChange(s_timer_id, 0);
                 return true;
                 break;
             case State::kWriting: {
                 storedevice::Result result;
-                if (StoreDevice::Write(s_start_address, sizeof(ConfigurationStore), reinterpret_cast<uint8_t*>(&s_store), result)) {
+#if defined(CONFIG_STORE_JOURNAL)
+                if (s_journal_is_refused) {
+                    if (CopyWrite(result)) {
+                        s_state = State::kIdle;
+                        return false;
+                    }
+                } else if (StoreDevice::Write(JournalAddress(JournalNext()) + sizeof(JournalSegment), sizeof(ConfigurationStore), reinterpret_cast<uint8_t*>(&s_store), result)) {
+                    s_state = State::kCommitting;
+                }
+#else
+                if (CopyWrite(result)) {
                     s_state = State::kIdle;
                     return false;
                 }
+#endif
                 assert(result == storedevice::Result::kOk);
                 return true;
             } break;
+#if defined(CONFIG_STORE_JOURNAL)
+            case State::kCommitting:
+                // The snapshot is valid once its header is written
+                if (JournalCommit()) {
+                    s_state = State::kIdle;
+                    return false;
+                }
+                return true;
+                break;
+            case State::kAppending:
+                if ((s_journal_record_size == 0) && !JournalRecordPrepare()) {
+                    s_state = State::kIdle;
+                    return false;
+                }
+
+                if (s_journal_compact) {
+                    s_state = State::kErasing;
+                    return true;
+                }
+
+                JournalAppend();
+                return true;
+                break;
+#endif
             default:
                 assert(0);
                 __builtin_unreachable();
@@ -585,7 +705,7 @@ class ConfigStore : StoreDevice {
         auto& flags = object.*field;
         if ((flags & flag) == 0) {
             flags |= flag;
-            SetStatusChanged();
+            SetStatusChanged(&flags, sizeof(flags));
         }
     }
 
@@ -593,7 +713,7 @@ class ConfigStore : StoreDevice {
         auto& flags = object.*field;
         if ((flags & flag) != 0) {
             flags &= ~flag;
-            SetStatusChanged();
+            SetStatusChanged(&flags, sizeof(flags));
         }
     }
 
@@ -602,17 +722,398 @@ class ConfigStore : StoreDevice {
         return (flags & flag) != 0;
     }
 
+    /*
+     * The store as it is without a journal or a second copy, the last kStoreSize bytes of the device.
+     */
+    uint32_t LegacyAddress() const { return StoreDevice::GetSize() - kStoreSize; }
+
+    /*
+     * The start of the whole erase units that hold at least size bytes before end.
+     * The sectors of a device can be non-uniform (GD32F4xx: 16K, 64K and 128K).
+     */
+    bool EraseUnitsBefore(uint32_t end, uint32_t size, uint32_t& start) const {
+        start = end;
+
+        while ((end - start) < size) {
+            if (start == 0) {
+                return false;
+            }
+            const auto kSectorSize = StoreDevice::GetSectorSize(start - 1);
+            if (kSectorSize > start) {
+                return false;
+            }
+            start -= kSectorSize;
+        }
+
+        return true;
+    }
+
+    static uint32_t CopyAddress(uint32_t copy) { return s_copy_address[copy]; }
+    static uint32_t CopyNext() { return (s_copy + 1) % kCopies; }
+
+    static uint32_t CopyCrc(const uint8_t* store) {
+        constexpr auto kOffset = offsetof(ConfigurationStore, sequence);
+        return crc32(0, &store[kOffset], static_cast<uint32_t>(sizeof(ConfigurationStore) - kOffset));
+    }
+
+    /*
+     * The sequence number and CRC32 of the copy to be written.
+     */
+    void CopySeal() {
+        auto* store = GetStore();
+        store->sequence = s_sequence + 1;
+        store->crc = CopyCrc(s_store);
+    }
+
+    /*
+     * The sealed store into the copy not in use, it is the copy in use when the write is done.
+     */
+    bool CopyWrite(storedevice::Result& result) {
+        if (!StoreDevice::Write(CopyAddress(CopyNext()), sizeof(ConfigurationStore), s_store, result)) {
+            return false;
+        }
+
+        s_copy = CopyNext();
+        s_sequence = GetStore()->sequence;
+        return true;
+    }
+
+    /*
+     * The copies are placed from the end of the device down. An erase of one copy must not erase the other,
+     * so a copy is at the end of the whole erase units that hold it (GD32F4xx: the last 4K of a 128K sector).
+     * When the first copy does not fit, both are in the same place and a write erases the store in use.
+     */
+    void CopyPlace() {
+        uint32_t end;
+        uint32_t start;
+
+        s_copy_address[0] = LegacyAddress();
+        s_copy_address[1] = LegacyAddress();
+
+        if (EraseUnitsBefore(StoreDevice::GetSize(), kStoreSize, end) && EraseUnitsBefore(end, kStoreSize, start)) {
+            s_copy_address[0] = end - kStoreSize;
+        }
+    }
+
+    /*
+     * A store written before the double buffering is in the place of the second copy, without a CRC32.
+     * It is loaded as is, the next write goes to the first copy.
+     */
+    void CopyLoad() {
+        CopyPlace();
+
+        CONFIGSTORE_DEBUG_PRINTF("copy0=%p, copy1=%p", reinterpret_cast<void*>(CopyAddress(0)), reinterpret_cast<void*>(CopyAddress(1)));
+
+        CopyHeader headers[kCopies];
+        storedevice::Result result;
+
+        for (uint32_t copy = 0; copy < kCopies; copy++) {
+            while (!StoreDevice::Read(CopyAddress(copy), sizeof(CopyHeader), reinterpret_cast<uint8_t*>(&headers[copy]), result)) {
+            }
+        }
+
+        const auto kIsValid0 = (memcmp(headers[0].magic_number, kMagicNumber, sizeof(kMagicNumber)) == 0);
+        const auto kIsValid1 = (memcmp(headers[1].magic_number, kMagicNumber, sizeof(kMagicNumber)) == 0);
+        const uint32_t kNewest = (kIsValid0 && kIsValid1) ? ((static_cast<int32_t>(headers[1].sequence - headers[0].sequence) > 0) ? 1 : 0) : (kIsValid1 ? 1 : 0);
+
+        for (uint32_t i = 0; i < kCopies; i++) {
+            const auto kCopy = (kNewest + i) % kCopies;
+
+            while (!StoreDevice::Read(CopyAddress(kCopy), kStoreSize, s_store, result)) {
+            }
+
+            if (CopyCrc(s_store) == headers[kCopy].crc) {
+                s_copy = kCopy;
+                s_sequence = headers[kCopy].sequence;
+                CONFIGSTORE_DEBUG_PRINTF("s_copy=%u, s_sequence=%u", static_cast<unsigned>(s_copy), static_cast<unsigned>(s_sequence));
+                return;
+            }
+        }
+
+        CONFIGSTORE_DEBUG_PUTS("No valid copy");
+
+        while (!StoreDevice::Read(CopyAddress(kCopies - 1), kStoreSize, s_store, result)) {
+        }
+
+        s_copy = kCopies - 1;
+        s_sequence = 0;
+    }
+
+#if defined(CONFIG_STORE_JOURNAL)
+    static uint32_t JournalAddress(uint32_t segment) { return s_journal_address[segment]; }
+    static uint32_t JournalSize(uint32_t segment) { return s_journal_size[segment]; }
+    static uint32_t JournalNext() { return (s_journal_segment + 1) % kJournalSegments; }
+
+    static uint32_t JournalRecordCrc(const JournalRecord& record, const uint8_t* data) {
+        // The crc member is not included
+        return crc32(crc32(0, reinterpret_cast<const uint8_t*>(&record), 2 * sizeof(uint16_t)), data, record.length);
+    }
+
+    static bool JournalIsDirty(uint32_t block) { return (s_journal_dirty[block / 32] & (1U << (block % 32))) != 0; }
+
+    static void JournalMark(const void* address, uint32_t size) {
+        const auto kOffset = static_cast<uint32_t>(static_cast<const uint8_t*>(address) - s_store);
+        assert((size != 0) && ((kOffset + size) <= sizeof(ConfigurationStore)));
+
+        for (auto block = kOffset / kJournalBlockSize; block <= ((kOffset + size - 1) / kJournalBlockSize); block++) {
+            s_journal_dirty[block / 32] |= (1U << (block % 32));
+        }
+    }
+
+    /*
+     * The segments are placed from the end of the device down, each in its own erase units.
+     * The erase units of the store without a journal are kept, a firmware without the journal still finds the store from before.
+     * Returns false when the segments do not fit, or an erase unit is larger than kJournalSegmentSizeMax.
+     */
+    bool JournalPlace() {
+        uint32_t end;
+
+        if (!EraseUnitsBefore(StoreDevice::GetSize(), kStoreSize, end)) {
+            return false;
+        }
+
+        for (auto segment = kJournalSegments; segment-- > 0;) {
+            uint32_t start;
+
+            if (!EraseUnitsBefore(end, 2 * kStoreSize, start) || ((end - start) > kJournalSegmentSizeMax)) {
+                return false;
+            }
+
+            s_journal_address[segment] = start;
+            s_journal_size[segment] = end - start;
+            end = start;
+
+            CONFIGSTORE_DEBUG_PRINTF("segment=%u, address=%p, size=%u", static_cast<unsigned>(segment), reinterpret_cast<void*>(start), static_cast<unsigned>(s_journal_size[segment]));
+        }
+
+        return true;
+    }
+
+    /*
+     * The newest segment with a valid snapshot, then its records are replayed.
+     * Without a journal the newest copy of the store without one is loaded, the first Commit compacts (migration).
+     * A refused journal keeps the store in the two copies, a Commit always writes a whole copy.
+     */
+    void JournalLoad() {
+        storedevice::Result result;
+
+        if (!JournalPlace()) {
+            CONFIGSTORE_DEBUG_PUTS("Journal refused");
+
+            s_journal_is_refused = true;
+            s_journal_compact = true;
+
+            CopyLoad();
+            return;
+        }
+
+        JournalSegment segments[kJournalSegments];
+
+        for (uint32_t segment = 0; segment < kJournalSegments; segment++) {
+            while (!StoreDevice::Read(JournalAddress(segment), sizeof(JournalSegment), reinterpret_cast<uint8_t*>(&segments[segment]), result)) {
+            }
+        }
+
+        s_journal_segment = kJournalNone;
+
+        for (uint32_t tries = 0; tries < kJournalSegments; tries++) {
+            auto newest = kJournalNone;
+
+            for (uint32_t segment = 0; segment < kJournalSegments; segment++) {
+                if ((segments[segment].magic != kJournalMagic) || (segments[segment].size != sizeof(ConfigurationStore))) {
+                    continue;
+                }
+                if ((newest == kJournalNone) || (static_cast<int32_t>(segments[segment].sequence - segments[newest].sequence) > 0)) {
+                    newest = segment;
+                }
+            }
+
+            if (newest == kJournalNone) {
+                break;
+            }
+
+            while (!StoreDevice::Read(JournalAddress(newest) + sizeof(JournalSegment), sizeof(ConfigurationStore), s_store, result)) {
+            }
+
+            if (crc32(0, s_store, sizeof(ConfigurationStore)) == segments[newest].crc) {
+                s_journal_segment = newest;
+                break;
+            }
+
+            segments[newest].magic = 0; // Not a valid snapshot, try the one before
+        }
+
+        if (s_journal_segment == kJournalNone) {
+            CONFIGSTORE_DEBUG_PUTS("No journal");
+
+            CopyLoad();
+
+            s_journal_segment = kJournalSegments - 1;
+            s_journal_sequence = 0;
+            s_journal_compact = true;
+            return;
+        }
+
+        s_journal_sequence = segments[s_journal_segment].sequence;
+
+        JournalReplay();
+
+        CONFIGSTORE_DEBUG_PRINTF("s_journal_segment=%u, s_journal_sequence=%u, s_journal_cursor=%u", static_cast<unsigned>(s_journal_segment), static_cast<unsigned>(s_journal_sequence), static_cast<unsigned>(s_journal_cursor));
+    }
+
+    /*
+     * A torn record (power loss during Commit) ends the journal, the next Commit compacts.
+     */
+    void JournalReplay() {
+        auto cursor = static_cast<uint32_t>(sizeof(JournalSegment) + sizeof(ConfigurationStore));
+        storedevice::Result result;
+
+        while ((cursor + sizeof(JournalRecord)) <= JournalSize(s_journal_segment)) {
+            JournalRecord record;
+
+            while (!StoreDevice::Read(JournalAddress(s_journal_segment) + cursor, sizeof(JournalRecord), reinterpret_cast<uint8_t*>(&record), result)) {
+            }
+
+            if ((record.offset == 0xFFFF) && (record.length == 0xFFFF)) {
+                break;
+            }
+
+            const auto kSize = static_cast<uint32_t>(sizeof(JournalRecord) + record.length);
+
+            if ((record.length == 0) || (record.length > kJournalRecordDataMax) || ((record.offset + record.length) > sizeof(ConfigurationStore)) || ((cursor + kSize) > JournalSize(s_journal_segment))) {
+                s_journal_compact = true;
+                break;
+            }
+
+            while (!StoreDevice::Read(JournalAddress(s_journal_segment) + cursor + sizeof(JournalRecord), record.length, s_journal_record, result)) {
+            }
+
+            if (JournalRecordCrc(record, s_journal_record) != record.crc) {
+                s_journal_compact = true;
+                break;
+            }
+
+            memcpy(&s_store[record.offset], s_journal_record, record.length);
+            cursor += kSize;
+        }
+
+        s_journal_cursor = cursor;
+    }
+
+    /*
+     * The next run of changed blocks into the record buffer.
+     * Returns false when nothing is left, sets s_journal_compact when the segment is full.
+     */
+    bool JournalRecordPrepare() {
+        uint32_t first = 0;
+
+        while ((first < kJournalBlocks) && !JournalIsDirty(first)) {
+            first++;
+        }
+
+        if (first == kJournalBlocks) {
+            return false;
+        }
+
+        auto last = first + 1;
+
+        while ((last < kJournalBlocks) && JournalIsDirty(last) && (((last + 1 - first) * kJournalBlockSize) <= kJournalRecordDataMax)) {
+            last++;
+        }
+
+        const auto kOffset = first * kJournalBlockSize;
+        const auto kLength = ((last * kJournalBlockSize) < sizeof(ConfigurationStore) ? (last * kJournalBlockSize) : static_cast<uint32_t>(sizeof(ConfigurationStore))) - kOffset;
+        const auto kSize = static_cast<uint32_t>(sizeof(JournalRecord) + kLength);
+
+        if ((s_journal_cursor + kSize) > JournalSize(s_journal_segment)) {
+            s_journal_compact = true;
+            return true;
+        }
+
+        for (auto block = first; block < last; block++) {
+            s_journal_dirty[block / 32] &= ~(1U << (block % 32));
+        }
+
+        JournalRecord record;
+        record.offset = static_cast<uint16_t>(kOffset);
+        record.length = static_cast<uint16_t>(kLength);
+        record.crc = JournalRecordCrc(record, &s_store[kOffset]);
+
+        memcpy(s_journal_record, &record, sizeof(JournalRecord));
+        memcpy(&s_journal_record[sizeof(JournalRecord)], &s_store[kOffset], kLength);
+        s_journal_record_size = kSize;
+
+        return true;
+    }
+
+    void JournalAppend() {
+        storedevice::Result result;
+
+        if (StoreDevice::Write(JournalAddress(s_journal_segment) + s_journal_cursor, s_journal_record_size, s_journal_record, result)) {
+            assert(result == storedevice::Result::kOk);
+            s_journal_cursor += s_journal_record_size;
+            s_journal_record_size = 0;
+        }
+    }
+
+    /*
+     * The header of the snapshot just written. The record buffer holds it,
+     * the device can still be writing from it with the next call.
+     */
+    bool JournalCommit() {
+        const auto kNext = JournalNext();
+
+        JournalSegment segment;
+        segment.magic = kJournalMagic;
+        segment.sequence = s_journal_sequence + 1;
+        segment.size = sizeof(ConfigurationStore);
+        segment.crc = crc32(0, s_store, sizeof(ConfigurationStore));
+        memcpy(s_journal_record, &segment, sizeof(JournalSegment));
+
+        storedevice::Result result;
+
+        if (!StoreDevice::Write(JournalAddress(kNext), sizeof(JournalSegment), s_journal_record, result)) {
+            return false;
+        }
+
+        assert(result == storedevice::Result::kOk);
+
+        s_journal_segment = kNext;
+        s_journal_sequence++;
+        s_journal_cursor = sizeof(JournalSegment) + sizeof(ConfigurationStore);
+        s_journal_compact = false;
+        memset(s_journal_dirty, 0, sizeof(s_journal_dirty));
+
+        CONFIGSTORE_DEBUG_PRINTF("s_journal_segment=%u, s_journal_sequence=%u", static_cast<unsigned>(s_journal_segment), static_cast<unsigned>(s_journal_sequence));
+        return true;
+    }
+#endif
+
     bool IsValid() {
         const auto* store = GetStore();
         return memcmp(store->magic_number, kMagicNumber, sizeof(kMagicNumber)) == 0 && memcmp(store->version, kVersion, sizeof(kVersion)) == 0;
     }
 
     static inline uint8_t s_store[kStoreSize];
-    static inline uint32_t s_start_address{0};
     static inline bool s_have_device{false};
     static inline State s_state{State::kIdle};
     static inline TimerHandle_t s_timer_id = kTimerIdNone;
     static inline ConfigStore* s_this;
+    static inline uint32_t s_copy{kCopies - 1}; ///< The copy in use
+    static inline uint32_t s_sequence{0};
+    static inline uint32_t s_copy_address[kCopies];
+#if defined(CONFIG_STORE_JOURNAL)
+    static inline uint32_t s_journal_address[kJournalSegments];
+    static inline uint32_t s_journal_size[kJournalSegments];
+    static inline bool s_journal_is_refused{false};
+    static inline uint32_t s_journal_segment{kJournalNone};
+    static inline uint32_t s_journal_sequence{0};
+    static inline uint32_t s_journal_cursor{0}; ///< Offset in the segment of the next record
+    static inline uint32_t s_journal_record_size{0}; ///< A record is waiting to be written
+    static inline uint32_t s_journal_dirty[(kJournalBlocks + 31) / 32];
+    alignas(4) static inline uint8_t s_journal_record[sizeof(JournalRecord) + kJournalRecordDataMax];
+    static inline bool s_journal_compact{false};
+#endif
 };
 
 inline void ConfigstoreCommit() {
@@ -47,6 +47,11 @@ class StoreDevice {
 
     [[nodiscard]] bool IsDetected() const { return detected_; }
     [[nodiscard]] uint32_t GetSectorSize() const;
+    /**
+     * @brief Size of the erase unit that contains offset.
+     * Equal to GetSectorSize() unless the device has non-uniform sectors.
+     */
+    [[nodiscard]] uint32_t GetSectorSize(uint32_t offset) const;
     [[nodiscard]] uint32_t GetSize() const;
 
     bool Read(uint32_t offset, uint32_t length, uint8_t* buffer, storedevice::Result& result);
@@ -707,7 +707,9 @@ inline constexpr uint32_t kVersionSize = 2;
 struct ConfigurationStore {
     uint8_t magic_number[configurationstore::kMagicNumberSize];
     uint8_t version[configurationstore::kVersionSize];
-    uint8_t reserved[10];
+    uint8_t reserved[2];
+    uint32_t crc;      ///< CRC32 from sequence to the end
+    uint32_t sequence; ///< Incremented with each write
 
     common::store::Global global;
     common::store::RemoteConfig remote_config;
@@ -736,6 +738,7 @@ struct ConfigurationStore {
     common::store::Widget widget;
 } PACKED;
 
+static_assert(offsetof(ConfigurationStore, sequence) == 12, "Wrong offset: sequence");
 static_assert(offsetof(ConfigurationStore, global) == 16, "Wrong offset: global");
 
 #if defined(_MSC_VER)
@@ -44,9 +44,32 @@ inline uint32_t spi_flash_get_sector_size()
     return spi::flash::SECTOR_SIZE;
 }
 
+/**
+ * The clock is limited to the maximum of the chip and CONFIG_SPI_FLASH_SPEED_HZ.
+ * spi_flash_probe sets the highest allowed.
+ */
+void spi_flash_set_speed_hz(uint32_t speed_hz);
+uint32_t spi_flash_get_speed_hz();
+
 bool spi_flash_cmd_read_fast(uint32_t offset, uint32_t length, uint8_t* data);
 bool spi_flash_cmd_write_multi(uint32_t offset, uint32_t length, const uint8_t* buffer);
 bool spi_flash_cmd_erase(uint32_t offset, uint32_t length);
 bool spi_flash_cmd_write_status(uint8_t sr);
 
+/*
+ * Non-blocking: a transfer is started when spi_flash_is_busy() returns false,
+ * spi_flash_is_busy() is polled for its completion.
+ * The data is transferred with DMA, when available. The buffer must stay valid until done.
+ * Program and erase are done when the status WIP bit is cleared.
+ */
+bool spi_flash_is_busy();
+void spi_flash_read_start(uint32_t offset, uint32_t length, uint8_t* data);
+void spi_flash_page_program_start(uint32_t offset, uint32_t length, const uint8_t* data);
+void spi_flash_sector_erase_start(uint32_t offset);
+
+/**
+ * Prints the read MB/s at each SPI clock allowed.
+ */
+void spi_flash_read_benchmark(uint32_t offset, uint32_t length);
+
 #endif  // SPI_SPI_FLASH_H_
@@ -36,6 +36,9 @@ void SpiInit() {
 	Gd32SpiChipSelect(GD32_SPI_CS_NONE);
 	Gd32SpiSetSpeedHz(SPI_XFER_SPEED_HZ);
 	Gd32SpiSetDataMode(GD32_SPI_MODE0);
+#if defined(SPI_DMA_RX_CHx)
+	Gd32SpiDmaBegin();
+#endif
 
 	Gd32GpioFsel(SPI_FLASH_CS_GPIOx, SPI_FLASH_CS_GPIO_PINx, GPIO_FSEL_OUTPUT);
 	GPIO_BOP(SPI_FLASH_CS_GPIOx) = SPI_FLASH_CS_GPIO_PINx;
@@ -51,11 +54,42 @@ void SpiInit() {
 #endif
 }
 
+void SpiSetSpeedHz(uint32_t speed_hz) {
+	while (SpiXferIsActive())
+		;
+
+	Gd32SpiSetSpeedHz(speed_hz);
+
+	/*
+	 * Gd32SpiSetSpeedHz rounds the divider down, the clock can be above speed_hz.
+	 * The flash must not be clocked above its limit, step to the next prescaler.
+	 */
+	auto actual_hz = Gd32SpiGetSpeedHz();
+
+	while (actual_hz > speed_hz) {
+		Gd32SpiSetSpeedHz(actual_hz / 2);
+		const auto kSlowerHz = Gd32SpiGetSpeedHz();
+
+		if (kSlowerHz == actual_hz) {
+			break; // The largest prescaler
+		}
+
+		actual_hz = kSlowerHz;
+	}
+}
+
+uint32_t SpiGetSpeedHz() {
+	return Gd32SpiGetSpeedHz();
+}
+
 inline static void SpiTransfern(char *buffer, uint32_t length) {
 	Gd32SpiTransfernb(buffer, buffer, length);
 }
 
 void SpiXfer(uint32_t length, const uint8_t *out, uint8_t *in, uint32_t flags) {
+	while (SpiXferIsActive())
+		;
+
 	if (flags & SPI_XFER_BEGIN) {
 		GPIO_BC(SPI_FLASH_CS_GPIOx) = SPI_FLASH_CS_GPIO_PINx;
 	}
@@ -74,3 +108,63 @@ void SpiXfer(uint32_t length, const uint8_t *out, uint8_t *in, uint32_t flags) {
 		GPIO_BOP(SPI_FLASH_CS_GPIOx) = SPI_FLASH_CS_GPIO_PINx;
 	}
 }
+
+#if defined(SPI_DMA_RX_CHx)
+static constexpr uint32_t kDmaLengthMin = 16; ///< A shorter transfer is done faster without DMA
+
+static uint32_t s_xfer_flags;
+static bool s_xfer_active;
+
+/*
+ * The stack is in the TCMSRAM, the DMA cannot access it.
+ */
+static bool IsDmaAccessible(const uint8_t *buffer) {
+	const auto kAddress = reinterpret_cast<uint32_t>(buffer);
+	return (kAddress < TCMSRAM_BASE) || (kAddress >= (TCMSRAM_BASE + (64U * 1024U)));
+}
+
+void SpiXferStart(uint32_t length, const uint8_t *out, uint8_t *in, uint32_t flags) {
+	if ((length < kDmaLengthMin) || (length > DMA_CHXCNT_CNT) || !IsDmaAccessible(out) || !IsDmaAccessible(in)) {
+		SpiXfer(length, out, in, flags);
+		return;
+	}
+
+	while (SpiXferIsActive())
+		;
+
+	if (flags & SPI_XFER_BEGIN) {
+		GPIO_BC(SPI_FLASH_CS_GPIOx) = SPI_FLASH_CS_GPIO_PINx;
+	}
+
+	s_xfer_flags = flags;
+	s_xfer_active = true;
+
+	Gd32SpiDmaTransferStart(out, in, length);
+}
+
+bool SpiXferIsActive() {
+	if (!s_xfer_active) {
+		return false;
+	}
+
+	if (Gd32SpiDmaIsActive()) {
+		return true;
+	}
+
+	s_xfer_active = false;
+
+	if (s_xfer_flags & SPI_XFER_END) {
+		GPIO_BOP(SPI_FLASH_CS_GPIOx) = SPI_FLASH_CS_GPIO_PINx;
+	}
+
+	return false;
+}
+#else
+void SpiXferStart(uint32_t length, const uint8_t *out, uint8_t *in, uint32_t flags) {
+	SpiXfer(length, out, in, flags);
+}
+
+bool SpiXferIsActive() {
+	return false;
+}
+#endif
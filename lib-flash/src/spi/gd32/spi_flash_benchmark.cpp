@@ -0,0 +1,99 @@
+/**
+ * @file spi_flash_benchmark.cpp
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+
+#include "spi/spi_flash.h"
+#include "./../../spi/spi_flash_internal.h"
+#include "timing.h"
+
+namespace {
+constexpr uint32_t kChunkSize = 4096;
+constexpr uint32_t kSpeedHzMin = 1000000;
+} // namespace
+
+static uint8_t s_buffer[kChunkSize]; ///< Not on the stack, the DMA cannot access the TCMSRAM
+
+static uint32_t ReadBlocking(uint32_t offset, uint32_t length) {
+    const auto kMicros = timing::Micros();
+
+    for (uint32_t count = 0; count < length; count += kChunkSize) {
+        spi_flash_cmd_read_fast(offset + count, kChunkSize, s_buffer);
+    }
+
+    return timing::Micros() - kMicros;
+}
+
+static uint32_t ReadStart(uint32_t offset, uint32_t length) {
+    const auto kMicros = timing::Micros();
+
+    for (uint32_t count = 0; count < length; count += kChunkSize) {
+        while (spi_flash_is_busy())
+            ;
+        spi_flash_read_start(offset + count, kChunkSize, s_buffer);
+    }
+
+    while (spi_flash_is_busy())
+        ;
+
+    return timing::Micros() - kMicros;
+}
+
+static void Print(const char* mode, uint32_t length, uint32_t micros) {
+    // Bytes per microsecond is MB/s
+    const auto kRate = (static_cast<uint64_t>(length) * 100U) / (micros == 0 ? 1 : micros);
+    printf(" %s %u.%02u MB/s", mode, static_cast<unsigned>(kRate / 100U), static_cast<unsigned>(kRate % 100U));
+}
+
+/**
+ * Reads length bytes, a multiple of 4K, at each SPI prescaler allowed.
+ * With spi_flash_cmd_read_fast and with spi_flash_read_start (DMA when available).
+ * The clock is restored.
+ */
+void spi_flash_read_benchmark(uint32_t offset, uint32_t length) {
+    const auto kSpeedHz = spi_flash_get_speed_hz();
+
+    length -= (length % kChunkSize);
+
+    spi_flash_set_speed_hz(CONFIG_SPI_FLASH_SPEED_HZ);
+
+    for (;;) {
+        const auto kActualHz = spi_flash_get_speed_hz();
+
+        printf("SPI flash read %u kB at %u kHz:", static_cast<unsigned>(length / 1024U), static_cast<unsigned>(kActualHz / 1000U));
+        Print("blocking", length, ReadBlocking(offset, length));
+        Print("start/poll", length, ReadStart(offset, length));
+        puts("");
+
+        if ((kActualHz / 2) < kSpeedHzMin) {
+            break;
+        }
+
+        spi_flash_set_speed_hz(kActualHz / 2);
+    }
+
+    spi_flash_set_speed_hz(kSpeedHz);
+}
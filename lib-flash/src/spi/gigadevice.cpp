@@ -44,6 +44,7 @@ struct GigadeviceSpiFlashParams
     const uint16_t kId;
     const uint16_t kNrBlocks;
     const char* const kName;
+    const uint8_t kSpeedMHz; ///< Fast read (0x0B) clock
 };
 
 static constexpr struct GigadeviceSpiFlashParams kGigadeviceSpiFlashTable[] = {
@@ -51,16 +52,19 @@ static constexpr struct GigadeviceSpiFlashParams kGigadeviceSpiFlashTable[] = {
 		0x6016,
 		64,
 		"GD25LQ",
+		104,
 	},
 	{
 		0x4015,
 		8,
 		"GD25Q40",
+		104,
 	},
 	{
 		0x4017,
 		128,
 		"GD25Q64B",
+		120,
 	},
 };
 
@@ -86,6 +90,7 @@ bool SpiFlashProbeGigadevice(struct SpiFlashInfo* flash, uint8_t* idcode)
 
     flash->name = params->kName;
     flash->size = 16U * spi::flash::SECTOR_SIZE * params->kNrBlocks;
+    flash->speed_hz = params->kSpeedMHz * 1000000U;
 
     return true;
 }
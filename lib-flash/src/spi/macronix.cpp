@@ -51,6 +51,7 @@ struct MacronixSpiFlashParams
     const uint16_t kIdcode;
     const uint16_t kNrBlocks;
     const char* const kName;
+    const uint8_t kSpeedMHz; ///< Fast read (0x0B) clock
 };
 
 static constexpr struct MacronixSpiFlashParams kMacronixSpiFlashTable[] = {
@@ -58,36 +59,43 @@ static constexpr struct MacronixSpiFlashParams kMacronixSpiFlashTable[] = {
 		0x2013,
 		8,
 		"MX25L4005",
+		85,
 	},
 	{
 		0x2014,
 		16,
 		"MX25L8005",
+		85,
 	},
 	{
 		0x2015,
 		32,
 		"MX25L1605D",
+		85,
 	},
 	{
 		0x2016,
 		64,
 		"MX25L3205D",
+		85,
 	},
 	{
 		0x2017,
 		128,
 		"MX25L6405D",
+		85,
 	},
 	{
 		0x2018,
 		256,
 		"MX25L12805D",
+		50,
 	},
 	{
 		0x2618,
 		256,
 		"MX25L12855E",
+		80,
 	},
 };
 
@@ -111,6 +119,7 @@ bool SpiFlashProbeMacronix(struct SpiFlashInfo *flash, uint8_t *idcode) {
 
 	flash->name = params->kName;
 	flash->size = 16U * spi::flash::SECTOR_SIZE * params->kNrBlocks;
+	flash->speed_hz = params->kSpeedMHz * 1000000U;
 
 	/* Clear BP# bits for read-only flash */
 	spi_flash_cmd_write_status(0);
@@ -27,6 +27,7 @@
  */
 
 #include <cstdint>
+#include <cassert>
 #include <algorithm>
 #include <time.h>
 
@@ -55,7 +56,8 @@
     } while (false)
 #endif
 
-static struct SpiFlashInfo s_flash = {"", 0, CMD_READ_STATUS};
+static struct SpiFlashInfo s_flash = {"", 0, CMD_READ_STATUS, SPI_XFER_SPEED_HZ};
+static bool s_is_programming; ///< A program or erase is started, the status WIP bit is polled
 
 #define IDCODE_PART_LEN 5
 
@@ -102,6 +104,14 @@ const char* spi_flash_get_name() {
     return s_flash.name;
 }
 
+void spi_flash_set_speed_hz(uint32_t speed_hz) {
+    SpiSetSpeedHz(std::min(speed_hz, std::min(s_flash.speed_hz, static_cast<uint32_t>(CONFIG_SPI_FLASH_SPEED_HZ))));
+}
+
+uint32_t spi_flash_get_speed_hz() {
+    return SpiGetSpeedHz();
+}
+
 static void SpiFlashAddr(uint32_t address, uint8_t* pCommand) {
     /* cmd[0] is actual command */
     pCommand[1] = static_cast<uint8_t>(address >> 16);
@@ -180,6 +190,7 @@ static bool SpiFlashWriteCommon(const uint8_t* pCommand, const uint32_t nCommand
 
     SpiFlashCmdWriteEnable();
     SpiFlashCmdWrite(pCommand, nCommandLength, pData, nDataLength);
+    s_is_programming = true;
 
     if (bWaitReady) {
         const auto kRet = SpiFlashCmdWaitReady(nTimeout);
@@ -313,6 +324,77 @@ bool spi_flash_cmd_erase(uint32_t nOffset, uint32_t length) {
     return true;
 }
 
+/*
+ * Non-blocking
+ */
+
+static bool SpiFlashIsWriteInProgress() {
+    uint8_t cmd = CMD_READ_STATUS;
+    uint8_t status;
+
+    SpiXfer(1, &cmd, nullptr, SPI_XFER_BEGIN);
+    SpiXfer(1, nullptr, &status, SPI_XFER_END);
+
+    return (status & STATUS_WIP) != 0;
+}
+
+bool spi_flash_is_busy() {
+    if (SpiXferIsActive()) {
+        return true;
+    }
+
+    if (s_is_programming) {
+        if (SpiFlashIsWriteInProgress()) {
+            return true;
+        }
+
+        s_is_programming = false;
+    }
+
+    return false;
+}
+
+void spi_flash_read_start(uint32_t offset, uint32_t length, uint8_t* data) {
+    assert(!spi_flash_is_busy());
+    assert(length != 0);
+    assert((offset < SPI_FLASH_16MB_BOUN) && (length <= (SPI_FLASH_16MB_BOUN - offset)));
+
+    uint8_t cmd[5];
+    cmd[0] = CMD_READ_ARRAY_FAST;
+    cmd[4] = 0x00;
+    SpiFlashAddr(offset, cmd);
+
+    SpiXfer(sizeof(cmd), cmd, nullptr, SPI_XFER_BEGIN);
+    SpiXferStart(length, nullptr, data, SPI_XFER_END);
+}
+
+void spi_flash_page_program_start(uint32_t offset, uint32_t length, const uint8_t* data) {
+    assert(!spi_flash_is_busy());
+    assert(length != 0);
+    assert(((offset % spi::flash::PAGE_SIZE) + length) <= spi::flash::PAGE_SIZE);
+
+    uint8_t cmd[4];
+    cmd[0] = CMD_PAGE_PROGRAM;
+    SpiFlashAddr(offset, cmd);
+
+    SpiFlashCmdWriteEnable();
+    SpiXfer(sizeof(cmd), cmd, nullptr, SPI_XFER_BEGIN);
+    SpiXferStart(length, data, nullptr, SPI_XFER_END);
+
+    s_is_programming = true;
+}
+
+void spi_flash_sector_erase_start(uint32_t offset) {
+    assert(!spi_flash_is_busy());
+    assert((offset % spi::flash::SECTOR_SIZE) == 0);
+
+    uint8_t cmd[4];
+    cmd[0] = CMD_ERASE_4K;
+    SpiFlashAddr(offset, cmd);
+
+    SpiFlashWriteCommon(cmd, sizeof(cmd), nullptr, 0, false);
+}
+
 bool spi_flash_cmd_write_status(uint8_t sr) {
     uint8_t cmd = CMD_WRITE_STATUS;
     const auto kRet = SpiFlashWriteCommon(&cmd, 1, &sr, 1, false);
@@ -348,7 +430,12 @@ bool spi_flash_probe() {
         return false;
     }
 
-    SPI_FLASH_DEBUG_PRINTF("Detected %s total %u bytes", s_flash.name, static_cast<unsigned>(s_flash.size));
+    spi_flash_set_speed_hz(s_flash.speed_hz);
+
+    SPI_FLASH_DEBUG_PRINTF("Detected %s total %u bytes, %u Hz", s_flash.name, static_cast<unsigned>(s_flash.size), static_cast<unsigned>(spi_flash_get_speed_hz()));
+#ifdef DEBUG_SPI_FLASH
+    spi_flash_read_benchmark(0, 64 * 1024);
+#endif
 
     return true;
 }
@@ -34,6 +34,7 @@ struct SpiFlashInfo
     uint32_t size;
     /* Poll cmd - for flash erase/program */
     uint8_t poll_cmd;
+    uint32_t speed_hz; ///< Maximum clock of the fast read, from the JEDEC ID
 };
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
@@ -68,10 +69,26 @@ struct SpiFlashInfo
 #define SPI_XFER_BEGIN 0x01 ///< Assert CS before transfer
 #define SPI_XFER_END 0x02   ///< Deassert CS after transfer
 
-#define SPI_XFER_SPEED_HZ 6000000 ///< 6MHz
+#define SPI_XFER_SPEED_HZ 6000000 ///< 6MHz, until the chip is identified
+
+/*
+ * The maximum clock allowed by the board wiring, the SPI prescaler is the
+ * nearest that does not exceed it, nor the maximum of the chip.
+ */
+#if !defined(CONFIG_SPI_FLASH_SPEED_HZ)
+#define CONFIG_SPI_FLASH_SPEED_HZ 50000000 ///< 50MHz
+#endif
 
 void SpiInit();
+void SpiSetSpeedHz(uint32_t speed_hz); ///< The clock does not exceed speed_hz
+uint32_t SpiGetSpeedHz(); ///< The actual clock
 void SpiXfer(uint32_t length, const uint8_t*out, uint8_t* in, uint32_t flags);
+/*
+ * The data phase with DMA, SpiXferIsActive() polls its completion and then deasserts CS (SPI_XFER_END).
+ * Without DMA, for a short transfer or a buffer the DMA cannot access, it is SpiXfer.
+ */
+void SpiXferStart(uint32_t length, const uint8_t* out, uint8_t* in, uint32_t flags);
+bool SpiXferIsActive();
 
 #if defined(H3)
 #define CONFIG_SPI_FLASH_MACRONIX
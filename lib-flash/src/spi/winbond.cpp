@@ -42,6 +42,7 @@ struct WinbondSpiFlashParams
     const uint16_t kId;
     const uint16_t kNrBlocks;
     const char* const kName;
+    const uint8_t kSpeedMHz; ///< Fast read (0x0B) clock
 };
 
 static constexpr struct WinbondSpiFlashParams kWinbondSpiFlashTable[] = {
@@ -49,61 +50,73 @@ static constexpr struct WinbondSpiFlashParams kWinbondSpiFlashTable[] = {
 		0x3013,
 		8,
 		"W25X40",
+		75,
 	},
 	{
 		0x3015,
 		32,
 		"W25X16",
+		75,
 	},
 	{
 		0x3016,
 		64,
 		"W25X32",
+		75,
 	},
 	{
 		0x3017,
 		128,
 		"W25X64",
+		75,
 	},
 	{
 		0x4014,
 		16,
 		"W25Q80BL",
+		50,
 	},
 	{
 		0x4015,
 		32,
 		"W25Q16CL",
+		80,
 	},
 	{
 		0x4016,
 		64,
 		"W25Q32BV",
+		104,
 	},
 	{
 		0x4017,
 		128,
 		"W25Q64CV",
+		80,
 	},
 	{
 		0x4018,
 		256,
 		"W25Q128BV",
+		104,
 	},
 	{
 		0x4019,
 		512,
 		"W25Q256",
+		104,
 	},
 	{
 		0x5014,
 		16,
 		"W25Q80BW",
+		80,
 	},
 	{
 		0x6015,
 		32,
 		"W25Q16DW",
+		80,
 	}
 };
 
@@ -125,6 +138,7 @@ bool SpiFlashProbeWinbond(struct SpiFlashInfo *flash, uint8_t *idcode) {
 
 	flash->name = params->kName;
 	flash->size = 16U * spi::flash::SECTOR_SIZE * params->kNrBlocks;
+	flash->speed_hz = params->kSpeedMHz * 1000000U;
 
 	return true;
 }
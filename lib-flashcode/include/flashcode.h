@@ -62,6 +62,11 @@ class FlashCode {
     [[nodiscard]] const char* GetName() const;
     [[nodiscard]] uint32_t GetSize() const;
     [[nodiscard]] uint32_t GetSectorSize() const;
+    /**
+     * @brief Size of the erasable unit that contains offset.
+     * Equal to GetSectorSize() unless the flash has non-uniform sectors.
+     */
+    [[nodiscard]] uint32_t GetSectorSize(uint32_t offset) const;
 
     bool Read(uint32_t offset, uint32_t length, uint8_t* buffer, flashcode::Result& result);
     bool Erase(uint32_t offset, uint32_t length, flashcode::Result& result);
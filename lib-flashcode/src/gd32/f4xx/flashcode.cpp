@@ -24,12 +24,107 @@
  */
 
 #include <cstdint>
+#include <cstring>
+#include <cassert>
 
 #include "flashcode.h"
 #include "gd32.h"
 #include "fmc_operation.h"
 #include "firmware/debug/debug_dump.h"
 
+/*
+ * Erase and Write are non-blocking: the first call starts the operation,
+ * the following calls (with the same arguments) poll the FMC and start the next
+ * sector or word. They return true when done.
+ *
+ * Non-blocking is for the FMC, not for the CPU: the slots are in bank 0, the same
+ * bank as the running code. While a sector is erased, every instruction fetch from
+ * flash stalls until the erase is done (up to the 128K sector erase time).
+ * Only the EMAC DMA keeps receiving into the Rx descriptor ring, a ring that is full
+ * during the stall drops the frames (rx.ovr in network::iface::GetCounters).
+ * Running only the erase/poll loop from RAM does not help, the network code runs from flash.
+ * So the network is not serviced during a sector erase, and frames are lost then:
+ * TFTP recovers them with its retransmission (RTO), it does not avoid the loss.
+ */
+
+namespace flashcode {
+enum class State { IDLE, ERASE_BUSY, WRITE_BUSY };
+
+static State s_state = State::IDLE;
+static uint32_t s_address;
+static uint32_t s_length;
+static const uint8_t* s_data;
+static uint32_t s_word;
+static bool s_is_staged;
+} // namespace flashcode
+
+using namespace flashcode;
+
+static void operation_start() {
+    fmc_unlock();
+    fmc_flag_clear(FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR | FMC_FLAG_PGSERR);
+}
+
+static bool operation_end(fmc_state_enum state, flashcode::Result& result) {
+    FMC_CTL &= ~(FMC_CTL_SER | FMC_CTL_SN | FMC_CTL_PG);
+    fmc_lock();
+
+    if (FMC_READY != state) {
+        FLASHCODE_DEBUG_PRINTF("state=%d [%p]", state, s_address);
+        result = flashcode::Result::kError;
+    }
+
+    s_state = State::IDLE;
+    return true;
+}
+
+/*
+ * Starts the erase of the sector that contains s_address.
+ * Returns the number of bytes up to the end of that sector, 0 when the address is not in the flash.
+ */
+static uint32_t sector_erase_start() {
+    const auto kSectorInfo = fmc_sector_info_get(s_address);
+
+    if (FMC_WRONG_SECTOR_NAME == kSectorInfo.sector_name) {
+        return 0;
+    }
+
+    FLASHCODE_DEBUG_PRINTF("Address 0x%08X is located in the : SECTOR_NUMBER_%d", s_address, kSectorInfo.sector_name);
+    FLASHCODE_DEBUG_PRINTF("Sector range: 0x%08X to 0x%08X", kSectorInfo.sector_start_addr, kSectorInfo.sector_end_addr);
+
+    FMC_CTL &= ~(FMC_CTL_SN | FMC_CTL_PSZ);
+    FMC_CTL |= (CTL_PSZ_WORD | FMC_CTL_SER | kSectorInfo.sector_num);
+    FMC_CTL |= FMC_CTL_START;
+
+    return kSectorInfo.sector_end_addr + 1 - s_address;
+}
+
+/*
+ * The next word is staged while the FMC programs the previous one.
+ * The tail of an unaligned length is padded with 0xFF.
+ */
+static void word_stage() {
+    const auto kCount = s_length < 4 ? s_length : 4;
+
+    s_word = 0xFFFFFFFF;
+    memcpy(&s_word, s_data, kCount);
+
+    s_data += kCount;
+    s_length -= kCount;
+    s_is_staged = true;
+}
+
+static void word_program() {
+    REG32(s_address) = s_word;
+
+    s_address += 4;
+    s_is_staged = false;
+
+    if (s_length != 0) {
+        word_stage();
+    }
+}
+
 uint32_t FlashCode::GetSize() const {
     return FMC_SIZE * 1024U;
 }
@@ -38,9 +133,19 @@ uint32_t FlashCode::GetSectorSize() const {
     return SIZE_16KB;
 }
 
+uint32_t FlashCode::GetSectorSize(uint32_t offset) const {
+    const auto kSectorInfo = fmc_sector_info_get(offset + FLASH_BASE);
+
+    if (FMC_WRONG_SECTOR_NAME == kSectorInfo.sector_name) {
+        return SIZE_16KB;
+    }
+
+    return kSectorInfo.sector_size;
+}
+
 bool FlashCode::Read(uint32_t offset, uint32_t length, uint8_t* buffer, flashcode::Result& result) {
     FLASHCODE_DEBUG_ENTRY();
-    FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%u[%d], data=%p[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0), data, (((uint32_t)(data) & 0x3) == 0));
+    FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%u[%d], data=%p[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0), buffer, (((uint32_t)(buffer) & 0x3) == 0));
 
     auto* src = reinterpret_cast<const uint32_t*>(offset + FLASH_BASE);
     auto* dst = reinterpret_cast<uint32_t*>(buffer);
@@ -61,88 +166,155 @@ bool FlashCode::Read(uint32_t offset, uint32_t length, uint8_t* buffer, flashcod
 
 bool FlashCode::Write(uint32_t offset, uint32_t length, const uint8_t* buffer, flashcode::Result& result) {
     FLASHCODE_DEBUG_ENTRY();
-    FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%u[%d], data=%p[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0), buffer, (((uint32_t)(buffer) & 0x3) == 0));
 
-    result = flashcode::Result::kError;
+    result = flashcode::Result::kOk;
 
-    fmc_unlock();
-    fmc_flag_clear(FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR | FMC_FLAG_PGSERR);
+    switch (s_state) {
+        case State::IDLE:
+            FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%u[%d], data=%p[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0), buffer, (((uint32_t)(buffer) & 0x3) == 0));
 
-    uint32_t address = offset + FLASH_BASE;
-    auto* data = reinterpret_cast<const uint32_t*>(buffer);
+            s_address = offset + FLASH_BASE;
+            s_length = length;
+            s_data = buffer;
 
-    while (length >= 4) {
-        fmc_state_enum state = fmc_word_program(address, *data);
+            if (s_length == 0) {
+                FLASHCODE_DEBUG_EXIT();
+                return true;
+            }
 
-        if (FMC_READY != state) {
-            FLASHCODE_DEBUG_PRINTF("state=%d [%p]", state, address);
-            FLASHCODE_DEBUG_EXIT();
-            return true;
-        }
+            operation_start();
 
-        data++;
-        address += 4;
-        length -= 4;
-    }
+            FMC_CTL &= ~FMC_CTL_PSZ;
+            FMC_CTL |= (CTL_PSZ_WORD | FMC_CTL_PG);
 
-    if (length > 0) {
-        fmc_state_enum state = fmc_word_program(address, *data);
+            word_stage();
+            word_program();
 
-        if (FMC_READY != state) {
-            FLASHCODE_DEBUG_PRINTF("state=%d [%p]", state, address);
+            s_state = State::WRITE_BUSY;
             FLASHCODE_DEBUG_EXIT();
-            return true;
-        }
-    }
+            return false;
+            break;
+        case State::WRITE_BUSY: {
+            /*
+             * One status check and at most one word per poll, a busy FMC returns to the superloop.
+             * x32 is the widest program parallelism (PSZ) without an external VPP. A word program
+             * takes much longer than a poll: a second word in the same poll would find the FMC busy,
+             * it could only be programmed by waiting (common/scripts/tests/flashcode).
+             */
+            const auto kState = fmc_state_get();
+
+            if (FMC_BUSY == kState) {
+                FLASHCODE_DEBUG_EXIT();
+                return false;
+            }
+
+            if ((FMC_READY != kState) || !s_is_staged) {
+                FLASHCODE_DEBUG_EXIT();
+                return operation_end(kState, result);
+            }
+
+            word_program();
 
-    fmc_lock();
-
-    debug::Dump(buffer, 64);
-    debug::Dump(reinterpret_cast<void *>(offset + FLASH_BASE), 64);
-
-    result = flashcode::Result::kOk;
+            FLASHCODE_DEBUG_EXIT();
+            return false;
+        } break;
+        case State::ERASE_BUSY:
+            // An erase is still running, it is finished first. A failed erase fails this write.
+            if (Erase(0, 0, result) && (flashcode::Result::kError == result)) {
+                FLASHCODE_DEBUG_EXIT();
+                return true;
+            }
+            FLASHCODE_DEBUG_EXIT();
+            return false;
+            break;
+        default:
+            assert(0);
+            __builtin_unreachable();
+            break;
+    }
 
-    FLASHCODE_DEBUG_EXIT();
+    assert(0);
+    __builtin_unreachable();
     return true;
 }
 
 bool FlashCode::Erase(uint32_t offset, uint32_t length, flashcode::Result& result) {
     FLASHCODE_DEBUG_ENTRY();
-    FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%x[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0));
 
-    result = flashcode::Result::kError;
+    result = flashcode::Result::kOk;
 
-    fmc_sector_info_struct sector_info;
-    uint32_t address = offset + FLASH_BASE;
+    switch (s_state) {
+        case State::IDLE: {
+            FLASHCODE_DEBUG_PRINTF("offset=%p[%d], length=%x[%d]", offset, (((uint32_t)(offset) & 0x3) == 0), length, (((uint32_t)(length) & 0x3) == 0));
 
-    auto size = static_cast<int>(length);
+            s_address = offset + FLASH_BASE;
+            s_length = length;
 
-    while (size > 0) {
-        sector_info = fmc_sector_info_get(address);
+            if (s_length == 0) {
+                FLASHCODE_DEBUG_EXIT();
+                return true;
+            }
 
-        if (FMC_WRONG_SECTOR_NAME == sector_info.sector_name) {
-            return true;
-        }
+            operation_start();
 
-        FLASHCODE_DEBUG_PRINTF("Address 0x%08X is located in the : SECTOR_NUMBER_%d", address, sector_info.sector_name);
-        FLASHCODE_DEBUG_PRINTF("Sector range: 0x%08X to 0x%08X", sector_info.sector_start_addr, sector_info.sector_end_addr);
-        FLASHCODE_DEBUG_PRINTF("nSector size: %d KB\n", (sector_info.sector_size / 1024));
+            const auto kSize = sector_erase_start();
 
-        fmc_unlock();
-        fmc_flag_clear(FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR | FMC_FLAG_PGSERR);
+            if (kSize == 0) {
+                FLASHCODE_DEBUG_EXIT();
+                return operation_end(FMC_OPERR, result);
+            }
 
-        if (FMC_READY != fmc_sector_erase(sector_info.sector_num)) {
-            return true;
-        }
+            s_length = (s_length > kSize) ? s_length - kSize : 0;
+            s_address += kSize;
 
-        fmc_lock();
+            s_state = State::ERASE_BUSY;
+            FLASHCODE_DEBUG_EXIT();
+            return false;
+        } break;
+        case State::ERASE_BUSY: {
+            const auto kState = fmc_state_get();
 
-        size -= static_cast<int>(sector_info.sector_size);
-        address += sector_info.sector_size;
-    }
+            if (FMC_BUSY == kState) {
+                FLASHCODE_DEBUG_EXIT();
+                return false;
+            }
 
-    result = flashcode::Result::kOk;
+            FMC_CTL &= ~(FMC_CTL_SER | FMC_CTL_SN);
 
-    FLASHCODE_DEBUG_EXIT();
+            if ((FMC_READY != kState) || (s_length == 0)) {
+                FLASHCODE_DEBUG_EXIT();
+                return operation_end(kState, result);
+            }
+
+            const auto kSize = sector_erase_start();
+
+            if (kSize == 0) {
+                FLASHCODE_DEBUG_EXIT();
+                return operation_end(FMC_OPERR, result);
+            }
+
+            s_length = (s_length > kSize) ? s_length - kSize : 0;
+            s_address += kSize;
+
+            FLASHCODE_DEBUG_EXIT();
+            return false;
+        } break;
+        case State::WRITE_BUSY:
+            // A write is still running, it is finished first. A failed write fails this erase.
+            if (Write(0, 0, nullptr, result) && (flashcode::Result::kError == result)) {
+                FLASHCODE_DEBUG_EXIT();
+                return true;
+            }
+            FLASHCODE_DEBUG_EXIT();
+            return false;
+            break;
+        default:
+            assert(0);
+            __builtin_unreachable();
+            break;
+    }
+
+    assert(0);
+    __builtin_unreachable();
     return true;
 }
@@ -81,6 +81,10 @@ uint32_t FlashCode::GetSectorSize() const {
     return kFlashSectorSize;
 }
 
+uint32_t FlashCode::GetSectorSize([[maybe_unused]] uint32_t offset) const {
+    return kFlashSectorSize;
+}
+
 bool FlashCode::Read(uint32_t offset, uint32_t length, uint8_t* pBuffer, flashcode::Result& result) {
     FLASHCODE_DEBUG_ENTRY();
     FLASHCODE_DEBUG_PRINTF("offset=%x, length=%u, data=%p", static_cast<unsigned>(offset), static_cast<unsigned>(length), reinterpret_cast<void*>(pBuffer));
@@ -0,0 +1,86 @@
+/**
+ * @file bootcontrol.h
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BOOTCONTROL_H_
+#define BOOTCONTROL_H_
+
+#include <cstdint>
+
+/*
+ * A/B application slots (CONFIG_FIRMWARE_AB_SLOTS).
+ *
+ * A new image is installed into the slot it is linked for, never into the running one.
+ * When that is not the active slot, it becomes the pending slot with kTries boots:
+ * the bootloader starts it, the application confirms it with Confirm().
+ * An image that is not confirmed within kTries boots is rolled back to the active slot.
+ *
+ * The record is appended to two flash sectors of its own, the valid record with the highest
+ * sequence wins. A full sector continues in the other one, the sector with the newest
+ * record is not erased: a power loss during an update leaves the previous record.
+ *
+ * An application image for slot B is linked with the FLASH region at OFFSET_UIMAGE_B
+ * (ORIGIN = 0x08060000) instead of OFFSET_UIMAGE, the length is FIRMWARE_MAX_SIZE.
+ * With images linked for slot A only, each is installed in place and there is no rollback.
+ * The application confirms with RemoteConfig, after it has run remoteconfig::kConfirmMillis.
+ */
+namespace bootcontrol {
+enum class Slot : uint8_t { kA, kB, kNone = 0xFF };
+
+inline constexpr uint8_t kTries = 3;
+
+/**
+ * @brief Flash offset of the slot, slot A for Slot::kNone.
+ */
+uint32_t SlotOffset(Slot slot);
+/**
+ * @brief The slot an address (reset handler) is inside, Slot::kNone when outside both slots.
+ */
+Slot SlotOf(uint32_t address);
+/**
+ * @brief The slot of the code calling, Slot::kNone for the bootloader.
+ */
+Slot SlotRunning();
+/**
+ * @brief The confirmed slot.
+ */
+Slot Active();
+/**
+ * @brief Bootloader: the slot to start, it counts the tries of a pending slot and rolls back.
+ * @return Slot::kNone when there is no valid image.
+ */
+Slot Select();
+/**
+ * @brief A verified image is written into slot.
+ * @return false when the record could not be written, the image is not started.
+ */
+bool Installed(Slot slot);
+/**
+ * @brief Application: the running slot is good, it becomes the active slot.
+ * @return false when the running slot is not pending or the record could not be written.
+ */
+bool Confirm();
+} // namespace bootcontrol
+
+#endif // BOOTCONTROL_H_
@@ -114,12 +114,80 @@ inline constexpr uint32_t kFileNameLength = sizeof(kFileName) - 1U;
 # else
 #  error Board is not supported
 # endif
+# if defined (CONFIG_FIRMWARE_AB_SLOTS)
+/*
+ * Two application slots, each executed in place: an image is linked for one of them.
+ * Slot A is at OFFSET_UIMAGE. The boot control record (active slot, pending slot,
+ * tries) has two 16K sectors of its own, in the second flash bank. See bootcontrol.h
+ * The boards with a second flash bank are selected in common/make/gd32/Board.mk
+ */
+#  define OFFSET_UIMAGE_B		0x060000		// 384K, sector 7 and 8
+#  define OFFSET_BOOTCONTROL	0x100000		// 1M, sector 12 and 13
+# endif
 #else
 # define IH_LOAD			0x40000000
 # define IH_EP				0x40000000
 # define OFFSET_UIMAGE		0x0
 # define FIRMWARE_MAX_SIZE  4096	// for dummy.bin
 #endif
+
+#if defined (GD32)
+/*
+ * The GD32 image is a raw binary, starting with the vector table.
+ * The reserved vector table entries 7, 8 and 9 hold the image info,
+ * stamped by common/scripts/gd32/image_crc.py:
+ * magic, image size and the CRC32 of the image without these 3 words.
+ * An image without the magic is rejected, unless CONFIG_FIRMWARE_ACCEPT_UNSTAMPED
+ * is defined (legacy images, installed without verification).
+ */
+namespace image {
+inline constexpr uint32_t kMagic = 0x32444741;	// "AGD2"
+inline constexpr uint32_t kInfoOffset = 7 * 4;
+inline constexpr uint32_t kInfoSize = 3 * 4;
+
+/*
+ * The image starts with the vector table: the initial stack pointer
+ * must be in RAM, the reset handler must be a Thumb address inside the image
+ * (inside one of the slots with CONFIG_FIRMWARE_AB_SLOTS).
+ */
+bool is_valid(const void *buffer);
+}  // namespace image
+
+/*
+ * Delta image, made by common/scripts/gd32/delta_gen.py (CONFIG_FIRMWARE_DELTA).
+ * The header, followed by the patches in ascending offset order,
+ * each patch followed by its data. The bytes not patched are taken
+ * from the installed (base) image, the image is patched in place.
+ * The patches are positional, there are no copy-from-base records:
+ * code that moves is sent again, a delta is only small for builds with the same layout.
+ * All fields are little endian.
+ */
+namespace delta {
+inline constexpr uint32_t kMagic = 0x44444741;	// "AGDD"
+
+struct Header {
+	uint32_t magic;
+	uint32_t offset;		///< Flash offset of the image, the slot
+	uint32_t base_size;
+	uint32_t base_crc;		///< CRC32 of the installed image
+	uint32_t size;
+	uint32_t crc;			///< CRC32 of the new image
+};
+
+struct Patch {
+	uint32_t offset;
+	uint32_t length;
+};
+}  // namespace delta
+#endif
+
+/*
+ * Running CRC32 of the image, block by block.
+ * firmware_install_end returns false when the CRC32 or the size does not match.
+ */
+bool firmware_install_start(const uint8_t *buffer, uint32_t buffer_size);
+bool firmware_install_continue(const uint8_t *buffer, uint32_t buffer_size);
+bool firmware_install_end(const uint8_t *buffer, uint32_t buffer_size);
 }  // namespace firmware
 
 #endif  // FIRMWARE_H_
@@ -30,6 +30,8 @@
 #include <cstdio>
 
 #include "flashcode.h"
+#include "firmware.h"
+#include "softwaretimers.h"
 
 #ifdef DEBUG_FLASHCODE_INSTALL
 #define FLASHCODE_INSTALL_DEBUG_ENTRY() DEBUG_ENTRY()
@@ -52,39 +54,165 @@
 #endif
 
 class FlashCodeInstall : FlashCode {
-    enum class ChunkState { kStart, kWrite };
+    enum class ChunkState { kStart, kWrite, kStream, kDelta };
+    /*
+     * Streaming install: the start of the vector table (initial SP, reset vector)
+     * is held back and written after the image is verified.
+     * 32 bytes is also one flash word on the GD32H7xx.
+     */
+    static constexpr uint32_t kVectorTableHoldSize = 32;
 
    public:
+    /**
+     * A chunk written at an offset is aligned to the flash program unit.
+     * The GD32H7xx programs 256-bit flash words.
+     */
+#if defined(GD32H7XX)
+    static constexpr uint32_t kWriteAlign = 32;
+#else
+    static constexpr uint32_t kWriteAlign = 4;
+#endif
+
     FlashCodeInstall();
     ~FlashCodeInstall();
 
+    /**
+     * Sector by sector, a sector with the same content is not erased and programmed.
+     */
     bool WriteFirmware(const uint8_t* buffer, uint32_t size);
 
     bool Erase(uint32_t size);
 
+    /**
+     * Streaming install: nothing is erased up front.
+     * Each WriteChunk erases the sectors ahead of the write cursor on demand,
+     * WriteChunkComplete takes the total written as the firmware size.
+     * The image CRC32 is computed while it is written, WriteChunkComplete
+     * commits the vector table only when it matches.
+     * With A/B slots (CONFIG_FIRMWARE_AB_SLOTS) the image goes into the slot it is linked for,
+     * which then boots as the pending slot, see bootcontrol.h
+     * With CONFIG_FIRMWARE_DELTA the image is staged in the sector buffer and compared
+     * before the erase: a sector with the same content is not erased and programmed.
+     */
+    bool StreamStart();
+    /**
+     * The firmware size is known before the first chunk.
+     * Checks that it fits and erases exactly the sectors needed, in the background.
+     * The erase is polled from the superloop, a chunk waits only for the sector erase in progress.
+     * With CONFIG_FIRMWARE_DELTA it only checks the size, nothing is erased ahead.
+     */
+    bool StreamReserve(uint32_t firmware_size);
+#if defined(CONFIG_FIRMWARE_DELTA)
+    /**
+     * Streaming delta install: the chunks are a delta image (firmware::delta).
+     * It is applied in place, sector by sector, against the installed image.
+     * Only the sectors with a changed content are erased and programmed.
+     * The first sector is always rewritten, its vector table is committed last,
+     * after the CRC32 of the new image is verified.
+     */
+    bool DeltaStart();
+#endif
+#if defined(CONFIG_FIRMWARE_LZ4)
+    /**
+     * Streaming install of an LZ4 frame compressed image.
+     * It is decompressed on the fly and written as with StreamStart.
+     * A match is copied from the image already in flash, the RAM needed is a 1K buffer.
+     * With the content size in the frame header (lz4 --content-size) the sectors
+     * are erased in the background, as with StreamReserve.
+     */
+    bool Lz4Start();
+#endif
+
     bool WriteChunk(const uint8_t* chunck, uint32_t chunk_size, uint32_t& written);
     bool WriteChunkComplete(uint32_t& write_count);
 
+    /**
+     * The bytes received: for an LZ4 image the compressed size.
+     */
+    [[nodiscard]] uint32_t GetWriteCount() const {
+#if defined(CONFIG_FIRMWARE_LZ4)
+        if (is_lz4_) {
+            return input_count_;
+        }
+#endif
+        return write_count_;
+    }
+
     static FlashCodeInstall* Get() { return s_this; }
 
    private:
+    bool IsFitting(uint32_t size) const;
+    bool IsSectorUnchanged(uint32_t offset, const uint8_t* buffer, uint32_t length) const;
+    bool EraseSectorPoll(flashcode::Result& result);
+    bool EraseSector();
+    bool EraseWait();
+    void EraseTimer();
+    bool EraseAhead(uint32_t size);
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    bool SelectSlot(const uint8_t* chunck, uint32_t chunk_size);
+#endif
+    bool ImageWrite(const uint8_t* chunck, uint32_t chunk_size);
     bool Open(const char* file_name);
     void Close();
     bool BuffersCompare(uint32_t size);
     bool Diff(uint32_t offset);
-    void Write(uint32_t offset);
+    bool Write(uint32_t offset);
     void Process(const char* file_name, uint32_t offset);
+#if defined(CONFIG_FIRMWARE_DELTA)
+    enum class DeltaState { kHeader, kPatch, kData };
+    bool DeltaWrite(const uint8_t* data, uint32_t size);
+    bool DeltaHeader();
+    bool DeltaSeek(uint32_t offset);
+    bool DeltaComplete();
+    bool DeltaVerify();
+    bool SectorStage(const uint8_t* data, uint32_t size);
+    bool SectorLoad(uint32_t offset, bool is_base);
+    bool SectorCommit();
+#endif
+#if defined(CONFIG_FIRMWARE_LZ4)
+    bool Lz4Write(const uint8_t* chunck, uint32_t chunk_size);
+    uint8_t Lz4History(uint32_t position) const;
+#endif
 
     uint32_t erase_size_{0};
     uint32_t flash_size_{0};
     uint32_t firmware_size_{0};
     uint32_t write_count_{0};
+    uint32_t stream_offset_{OFFSET_UIMAGE}; ///< Streaming install: the slot written
+    uint32_t write_micros_{0}; ///< Time spent programming the chunks, streaming install
     ChunkState chunk_state_{ChunkState::kStart};
+    uint8_t vector_table_[kVectorTableHoldSize];
     uint8_t* file_buffer_{nullptr};
     uint8_t* flash_buffer_{nullptr};
     FILE* file_{nullptr};
 
+#if defined(CONFIG_FIRMWARE_DELTA)
+    firmware::delta::Header delta_header_;
+    firmware::delta::Patch delta_patch_;
+    uint32_t delta_count_{0};    ///< Bytes of the header or patch received
+    uint32_t delta_position_{0}; ///< Image offset written by the patch
+    uint32_t image_size_{0};        ///< A committed sector is erased beyond it
+    uint32_t sectors_rewritten_{0};
+    uint32_t sectors_unchanged_{0};
+    uint32_t sector_offset_{0};     ///< Image offset of the sector in file_buffer_
+    uint32_t sector_size_{0};       ///< 0 when no sector is loaded
+    DeltaState delta_state_{DeltaState::kHeader};
+#endif
+#if defined(CONFIG_FIRMWARE_LZ4)
+    uint32_t input_count_{0}; ///< Compressed bytes received
+    bool is_lz4_{false};
+#endif
+
     bool have_flash_{false};
+    bool is_erasing_{false};
+
+    TimerHandle_t erase_timer_id_{kTimerIdNone};
+
+    void static StaticCallbackFunctionEraseTimer([[maybe_unused]] TimerHandle_t handle) { s_this->EraseTimer(); }
+#if defined(CONFIG_FIRMWARE_LZ4)
+    static bool StaticCallbackFunctionLz4Flush(const uint8_t* data, uint32_t size) { return s_this->ImageWrite(data, size); }
+    static uint8_t StaticCallbackFunctionLz4History(uint32_t position) { return s_this->Lz4History(position); }
+#endif
 
     inline static FlashCodeInstall* s_this;
 };
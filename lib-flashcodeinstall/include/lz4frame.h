@@ -0,0 +1,106 @@
+/**
+ * @file lz4frame.h
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LZ4FRAME_H_
+#define LZ4FRAME_H_
+
+#include <cstdint>
+
+/*
+ * Streaming decoder for the LZ4 frame format, fed with chunks of any size.
+ * The output is collected in a small buffer and handed to Flush.
+ * A match that reaches back before the buffer is read with History,
+ * for the firmware install that is the image already written into flash.
+ * So the RAM needed does not depend on the 64K LZ4 window.
+ */
+namespace lz4 {
+inline constexpr uint32_t kFrameMagic = 0x184D2204;
+
+enum class Result { kContinue, kDone, kError };
+
+class Frame {
+    static constexpr uint32_t kBufferSize = 1024;
+
+   public:
+    using Flush = bool (*)(const uint8_t* data, uint32_t size);
+    using History = uint8_t (*)(uint32_t position);
+
+    void Init(Flush flush, History history);
+    Result Decode(const uint8_t* data, uint32_t size);
+    /**
+     * @brief Flushes what is left in the buffer.
+     * @return false when the frame is not complete.
+     */
+    bool Finish();
+
+    /**
+     * @brief The content size from the frame header, 0 when not present.
+     */
+    [[nodiscard]] uint32_t GetContentSize() const { return content_size_; }
+    [[nodiscard]] uint32_t GetSize() const { return out_count_; }
+
+   private:
+    enum class State {
+        kMagic,
+        kFlags,
+        kBlockDescriptor,
+        kHeader,
+        kBlockSize,
+        kRaw,
+        kToken,
+        kLiteralLength,
+        kLiterals,
+        kOffset,
+        kMatchLength,
+        kBlockChecksum,
+        kContentChecksum,
+        kEnd,
+        kError
+    };
+
+    bool Put(uint8_t byte);
+    bool Copy();
+    void AfterLiterals();
+    void EndBlock();
+
+    Flush flush_{nullptr};
+    History history_{nullptr};
+    uint32_t value_{0};
+    uint32_t count_{0};
+    uint32_t header_size_{0};
+    uint32_t content_size_{0};
+    uint32_t block_size_{0};
+    uint32_t block_max_size_{0}; ///< From the block descriptor
+    uint32_t length_{0};
+    uint32_t match_{0};
+    uint32_t out_count_{0};
+    uint32_t flushed_{0};
+    State state_{State::kMagic};
+    uint8_t flags_{0};
+    uint8_t buffer_[kBufferSize];
+};
+} // namespace lz4
+
+#endif // LZ4FRAME_H_
@@ -23,34 +23,107 @@
  * THE SOFTWARE.
  */
 
-#ifdef NDEBUG
-# undef NDEBUG
-#endif
-
 #include <cstdint>
-#include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <zlib.h>
 
 #include "firmware.h"
-#include "ubootheader.h"
+#if defined (GD32)
+# include "timing.h"
+# include "gd32.h"
+# if defined (CONFIG_FIRMWARE_AB_SLOTS)
+#  include "bootcontrol.h"
+# endif
+#else
+# include "ubootheader.h"
+#endif
 #include "firmware/debug/debug_debug.h"
 
 namespace firmware {
+#if defined (GD32)
+namespace image {
+bool is_valid(const void *buffer) {
+	uint32_t vectors[2];
+	memcpy(vectors, buffer, sizeof(vectors));
+
+	const auto kStackPointer = vectors[0];
+	const auto kResetHandler = vectors[1];
+
+	if (((kStackPointer & 0x3) != 0) || (kStackPointer < 0x10000000) || (kStackPointer > 0x40000000)) {
+		return false;
+	}
+
+	if ((kResetHandler & 0x1) == 0) {
+		return false;
+	}
+
+#if defined (CONFIG_FIRMWARE_AB_SLOTS)
+	return bootcontrol::SlotOf(kResetHandler) != bootcontrol::Slot::kNone;
+#else
+	return (kResetHandler > (FLASH_BASE + OFFSET_UIMAGE)) && (kResetHandler < (FLASH_BASE + OFFSET_UIMAGE + FIRMWARE_MAX_SIZE));
+#endif
+}
+}  // namespace image
+#endif
+
 enum class State {
 	kIdle, kStart, kContinue
 };
 
 static auto s_State = State::kIdle;
 static uint32_t s_nCRC;
+static uint32_t s_nSize;
+static uint32_t s_nExpectedCRC;
+static uint32_t s_nExpectedSize;
+static bool s_bHasCRC;
+#if defined (GD32)
+static uint32_t s_nMicros;
+#endif
 
 bool firmware_install_start(const uint8_t *buffer, uint32_t buffer_size) {
 	DEBUG_ENTRY();
 	DEBUG_PRINTF("Firmware: Buffer = %p, Buffer size = %u", reinterpret_cast<const void *>(buffer), static_cast<unsigned>(buffer_size));
 
-	assert(s_State == State::kIdle);
-	s_State = State::kStart;
+	// A previous install can have been aborted
+	s_State = State::kIdle;
+	s_nCRC = 0;
+	s_nSize = 0;
+	s_bHasCRC = false;
+
+#if defined (GD32)
+	s_nMicros = 0;
+
+	if (buffer_size < (image::kInfoOffset + image::kInfoSize)) {
+		DEBUG_EXIT();
+		return false;
+	}
+
+	uint32_t info[3];
+	memcpy(info, buffer + image::kInfoOffset, sizeof(info));
+
+	s_bHasCRC = (info[0] == image::kMagic);
+
+#if !defined (CONFIG_FIRMWARE_ACCEPT_UNSTAMPED)
+	// Without the image info the upload cannot be verified, it is rejected before anything is written
+	if (!s_bHasCRC) {
+		puts("Error: firmware has no image info (image_crc.py)");
+		DEBUG_EXIT();
+		return false;
+	}
+#endif
 
-	assert(sizeof(struct TImageHeader) <= buffer_size);
+	s_nExpectedSize = info[1];
+	s_nExpectedCRC = info[2];
+
+	s_nCRC = crc32(0, buffer, image::kInfoOffset);
+	s_nCRC = crc32(s_nCRC, buffer + image::kInfoOffset + image::kInfoSize, buffer_size - (image::kInfoOffset + image::kInfoSize));
+	s_nSize = buffer_size;
+#else
+	if (sizeof(struct TImageHeader) > buffer_size) {
+		DEBUG_EXIT();
+		return false;
+	}
 
 	UBootHeader uboot_header(buffer);
 	uboot_header.Dump();
@@ -63,6 +136,12 @@ bool firmware_install_start(const uint8_t *buffer, uint32_t buffer_size) {
 		return false;
 	}
 
+	const auto *header = reinterpret_cast<const struct TImageHeader *>(buffer);
+
+	s_bHasCRC = true;
+	s_nExpectedSize = __builtin_bswap32(header->ih_size);
+	s_nExpectedCRC = __builtin_bswap32(header->ih_dcrc);
+
 	const uint32_t kFirmwareChunk = buffer_size - sizeof(struct TImageHeader);
 
 	if (kFirmwareChunk > 0) {
@@ -71,22 +150,34 @@ bool firmware_install_start(const uint8_t *buffer, uint32_t buffer_size) {
 		const auto *firmware = buffer + sizeof(struct TImageHeader);
 
 		s_nCRC = crc32(0, firmware, kFirmwareChunk);
+		s_nSize = kFirmwareChunk;
 	}
+#endif
+
+	DEBUG_PRINTF("Has CRC? %s, Size = %u, CRC = %x", s_bHasCRC ? "Yes" : "No", static_cast<unsigned>(s_nExpectedSize), static_cast<unsigned>(s_nExpectedCRC));
+
+	s_State = State::kStart;
 
 	DEBUG_EXIT();
 	return true;
 }
 
 bool firmware_install_continue(const uint8_t *buffer, uint32_t buffer_size) {
-	DEBUG_ENTRY();
-	DEBUG_PRINTF("Firmware: Buffer = %p, Buffer size = %u", reinterpret_cast<const void *>(buffer), static_cast<unsigned>(buffer_size));
+	if ((s_State != State::kStart) && (s_State != State::kContinue)) {
+		return false;
+	}
 
-	assert((s_State == State::kStart) || (s_State == State::kContinue));
 	s_State = State::kContinue;
 
+#if defined (GD32)
+	const auto kMicros = timing::Micros();
+#endif
 	s_nCRC = crc32(s_nCRC, buffer, buffer_size);
+	s_nSize += buffer_size;
+#if defined (GD32)
+	s_nMicros += timing::Micros() - kMicros;
+#endif
 
-	DEBUG_EXIT();
 	return true;
 }
 
@@ -94,12 +185,30 @@ bool firmware_install_end(const uint8_t *buffer, uint32_t buffer_size) {
 	DEBUG_ENTRY();
 	DEBUG_PRINTF("Firmware: Buffer = %p, Buffer size = %u", reinterpret_cast<const void *>(buffer), static_cast<unsigned>(buffer_size));
 
-	assert(s_State == State::kContinue);
+	if (!firmware_install_continue(buffer, buffer_size)) {
+		DEBUG_EXIT();
+		return false;
+	}
+
 	s_State = State::kIdle;
 
-	s_nCRC = crc32(s_nCRC, buffer, buffer_size);
+	DEBUG_PRINTF("CRC: %x, Size: %u", static_cast<unsigned>(s_nCRC), static_cast<unsigned>(s_nSize));
+#if defined (GD32)
+	DEBUG_PRINTF("CRC: %u us, %u kB/s", static_cast<unsigned>(s_nMicros), static_cast<unsigned>(s_nMicros == 0 ? 0 : (s_nSize * 1000U) / s_nMicros));
+#endif
+
+	// Only with CONFIG_FIRMWARE_ACCEPT_UNSTAMPED
+	if (!s_bHasCRC) {
+		puts("Warning: firmware has no CRC");
+		DEBUG_EXIT();
+		return true;
+	}
 
-	DEBUG_PRINTF("CRC: %x", static_cast<unsigned>(s_nCRC));
+	if ((s_nSize != s_nExpectedSize) || (s_nCRC != s_nExpectedCRC)) {
+		printf("Error: firmware CRC %x:%x, size %u:%u\n", static_cast<unsigned>(s_nCRC), static_cast<unsigned>(s_nExpectedCRC), static_cast<unsigned>(s_nSize), static_cast<unsigned>(s_nExpectedSize));
+		DEBUG_EXIT();
+		return false;
+	}
 
 	DEBUG_EXIT();
 	return true;
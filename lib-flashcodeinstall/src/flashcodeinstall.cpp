@@ -24,12 +24,53 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 
 #include "flashcodeinstall.h"
 #include "firmware.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "bootcontrol.h"
+#endif
+#if defined(CONFIG_FIRMWARE_LZ4)
+#include "lz4frame.h"
+#endif
 #include "display.h" // IWYU pragma: keep
 #include "watchdog.h"
+#include "softwaretimers.h"
+#if defined(GD32)
+#include "timing.h"
+#endif
+
+/*
+ * Compare before erase: a sector that already holds the image content,
+ * and is erased beyond the end of the image, is left untouched.
+ * The GD32 flash is memory mapped, no copy is needed.
+ */
+bool FlashCodeInstall::IsSectorUnchanged(uint32_t offset, const uint8_t* buffer, uint32_t length) const {
+#if defined(GD32)
+    const auto* flash = reinterpret_cast<const uint8_t*>(FLASH_BASE + offset);
+
+    if (memcmp(flash, buffer, length) != 0) {
+        return false;
+    }
+
+    const auto kSectorSize = FlashCode::GetSectorSize(offset);
+
+    for (auto i = length; i < kSectorSize; i++) {
+        if (flash[i] != 0xFF) {
+            return false;
+        }
+    }
+
+    return true;
+#else
+    (void)offset;
+    (void)buffer;
+    (void)length;
+    return false;
+#endif
+}
 
 bool FlashCodeInstall::WriteFirmware(const uint8_t* buffer, uint32_t size) {
     FLASHCODE_INSTALL_DEBUG_ENTRY();
@@ -37,7 +78,6 @@ bool FlashCodeInstall::WriteFirmware(const uint8_t* buffer, uint32_t size) {
     assert(buffer != nullptr);
     assert(size != 0);
 
-	
     FLASHCODE_INSTALL_DEBUG_PRINTF("(%p + %x)=%p, flash_size_=%u", reinterpret_cast<void*>(OFFSET_UIMAGE), static_cast<unsigned>(size), reinterpret_cast<void*>(OFFSET_UIMAGE + size), static_cast<unsigned>(flash_size_));
 
     if ((OFFSET_UIMAGE + size) > flash_size_) {
@@ -54,37 +94,61 @@ bool FlashCodeInstall::WriteFirmware(const uint8_t* buffer, uint32_t size) {
 
     puts("Write firmware");
 
-    const auto kSectorSize = FlashCode::GetSectorSize();
-    const auto kEraseSize = (size + kSectorSize - 1) & ~(kSectorSize - 1);
+    Display::Get()->TextStatus("Writing", ansi::Colours::Colour::kGreen);
 
-    FLASHCODE_INSTALL_DEBUG_PRINTF("size=%x, kSectorSize=%x, kEraseSize=%x", static_cast<unsigned>(size), static_cast<unsigned>(kSectorSize), static_cast<unsigned>(kEraseSize));
+    uint32_t offset = 0;
+    uint32_t sectors = 0;
+    uint32_t skipped = 0;
+    auto is_written = true;
 
-    Display::Get()->TextStatus("Erase", ansi::Colours::Colour::kGreen);
+    while (offset < size) {
+        const auto kSectorSize = FlashCode::GetSectorSize(OFFSET_UIMAGE + offset);
+        const auto kLength = (size - offset) < kSectorSize ? (size - offset) : kSectorSize;
 
-    flashcode::Result result;
+        sectors++;
 
-    while (!FlashCode::Erase(OFFSET_UIMAGE, kEraseSize, result)) {
-    }
+        if (IsSectorUnchanged(OFFSET_UIMAGE + offset, &buffer[offset], kLength)) {
+            skipped++;
+            offset += kSectorSize;
+            continue;
+        }
 
-    if (flashcode::Result::kError == result) {
-        puts("Error: flash erase");
-        return false;
-    }
+        flashcode::Result result;
 
-    Display::Get()->TextStatus("Writing", ansi::Colours::Colour::kGreen);
+        while (!FlashCode::Erase(OFFSET_UIMAGE + offset, kSectorSize, result)) {
+        }
 
-    while (!FlashCode::Write(OFFSET_UIMAGE, size, buffer, result)) {
-    }
+        if (flashcode::Result::kError == result) {
+            puts("Error: flash erase");
+            is_written = false;
+            break;
+        }
 
-    if (flashcode::Result::kError == result) {
-        puts("Error: flash write");
-        return false;
+        while (!FlashCode::Write(OFFSET_UIMAGE + offset, kLength, &buffer[offset], result)) {
+        }
+
+        if (flashcode::Result::kError == result) {
+            puts("Error: flash write");
+            is_written = false;
+            break;
+        }
+
+        Display::Get()->Progress();
+
+        offset += kSectorSize;
     }
 
     if (kWatchdog) {
         watchdog::Init();
     }
 
+    if (!is_written) {
+        FLASHCODE_INSTALL_DEBUG_EXIT();
+        return false;
+    }
+
+    printf("Write firmware: %u sectors, %u unchanged\n", static_cast<unsigned>(sectors), static_cast<unsigned>(skipped));
+
     Display::Get()->TextStatus("Done", ansi::Colours::Colour::kGreen);
 
     FLASHCODE_INSTALL_DEBUG_EXIT();
@@ -126,14 +190,313 @@ bool FlashCodeInstall::Erase(uint32_t firmware_size) {
     return false;
 }
 
+bool FlashCodeInstall::StreamStart() {
+    FLASHCODE_INSTALL_DEBUG_ENTRY();
+
+    if (erase_timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(erase_timer_id_);
+    }
+
+    if (!EraseWait()) {
+        FLASHCODE_INSTALL_DEBUG_EXIT();
+        return false;
+    }
+
+    firmware_size_ = 0;
+    erase_size_ = 0;
+    write_count_ = 0;
+    write_micros_ = 0;
+    stream_offset_ = OFFSET_UIMAGE;
+    chunk_state_ = ChunkState::kStream;
+#if defined(CONFIG_FIRMWARE_DELTA)
+    image_size_ = FIRMWARE_MAX_SIZE; // A staged sector is erased beyond the data
+    sectors_rewritten_ = 0;
+    sectors_unchanged_ = 0;
+    sector_offset_ = 0;
+    sector_size_ = 0;
+#endif
+#if defined(CONFIG_FIRMWARE_LZ4)
+    is_lz4_ = false;
+#endif
+
+    FLASHCODE_INSTALL_DEBUG_EXIT();
+    return true;
+}
+
+#if defined(CONFIG_FIRMWARE_LZ4)
+static lz4::Frame s_lz4; // Not on the stack, it has a 1K buffer
+
+bool FlashCodeInstall::Lz4Start() {
+    FLASHCODE_INSTALL_DEBUG_ENTRY();
+
+    if (!StreamStart()) {
+        FLASHCODE_INSTALL_DEBUG_EXIT();
+        return false;
+    }
+
+    s_lz4.Init(StaticCallbackFunctionLz4Flush, StaticCallbackFunctionLz4History);
+    input_count_ = 0;
+    is_lz4_ = true;
+
+    FLASHCODE_INSTALL_DEBUG_EXIT();
+    return true;
+}
+#endif
+
+/*
+ * The firmware size is known up front (TFTP tsize).
+ * The sectors are erased in the background, one per timer tick,
+ * so the erase is interleaved with the transfer.
+ * With A/B slots the slot is known from the first chunk, the erase starts there.
+ * With the sector buffer (CONFIG_FIRMWARE_DELTA) nothing is erased ahead,
+ * a sector is compared before it is erased, see SectorStage.
+ */
+bool FlashCodeInstall::StreamReserve(uint32_t firmware_size) {
+    FLASHCODE_INSTALL_DEBUG_ENTRY();
+    FLASHCODE_INSTALL_DEBUG_PRINTF("firmware_size=%u", static_cast<unsigned>(firmware_size));
+
+    if ((chunk_state_ != ChunkState::kStream) || (firmware_size == 0) || !IsFitting(firmware_size)) {
+        FLASHCODE_INSTALL_DEBUG_EXIT();
+        return false;
+    }
+
+    firmware_size_ = firmware_size;
+
+#if !defined(CONFIG_FIRMWARE_DELTA)
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    // Until the first chunk is written the slot is not known, SelectSlot starts the erase
+    const auto kIsSlotKnown = (write_count_ != 0);
+#else
+    constexpr auto kIsSlotKnown = true;
+#endif
+
+    if (kIsSlotKnown && (erase_timer_id_ == kTimerIdNone)) {
+        erase_timer_id_ = SoftwareTimerAdd(1, StaticCallbackFunctionEraseTimer);
+    }
+#endif
+
+    FLASHCODE_INSTALL_DEBUG_EXIT();
+    return true;
+}
+
+bool FlashCodeInstall::IsFitting(uint32_t size) const {
+    if ((size > FIRMWARE_MAX_SIZE) || ((stream_offset_ + size) > flash_size_)) {
+        printf("Error: size %u > %u\n", static_cast<unsigned>(size), static_cast<unsigned>(FIRMWARE_MAX_SIZE));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * One poll of the erase of the sector at the erase cursor.
+ * Returns false while the FMC is busy, the result is valid when true.
+ * The offset does not move until the erase is done, so the next call continues the same erase.
+ */
+bool FlashCodeInstall::EraseSectorPoll(flashcode::Result& result) {
+    const auto kOffset = stream_offset_ + erase_size_;
+    const auto kSectorSize = FlashCode::GetSectorSize(kOffset);
+
+    if (!FlashCode::Erase(kOffset, kSectorSize, result)) {
+        is_erasing_ = true;
+        return false;
+    }
+
+    is_erasing_ = false;
+
+    FLASHCODE_INSTALL_DEBUG_PRINTF("kOffset=%x, kSectorSize=%x", static_cast<unsigned>(kOffset), static_cast<unsigned>(kSectorSize));
+
+    if (flashcode::Result::kError == result) {
+        puts("Error: flash erase");
+        return true;
+    }
+
+    erase_size_ += kSectorSize;
+    return true;
+}
+
+bool FlashCodeInstall::EraseSector() {
+    flashcode::Result result;
+    while (!EraseSectorPoll(result)) {
+        watchdog::Feed();
+    }
+
+    return (flashcode::Result::kOk == result);
+}
+
+/*
+ * The flash cannot be programmed while a sector is erased.
+ * The wait itself is short: the code runs from the same flash bank, so the
+ * instruction fetch of this loop already stalls until the erase is done.
+ */
+bool FlashCodeInstall::EraseWait() {
+    if (is_erasing_) {
+        return EraseSector();
+    }
+
+    return true;
+}
+
+/*
+ * The erase timer does not wait for the FMC: it starts a sector erase,
+ * polls it once per tick and starts the next one.
+ * The superloop does not run during the erase, the instruction fetch from flash
+ * stalls until the sector is erased. Only the EMAC DMA fills the Rx ring meanwhile,
+ * a full ring drops frames, the TFTP retransmission resends them.
+ * With DEBUG_TFTP, TFTPFileServer prints the Rx drops of an install.
+ */
+void FlashCodeInstall::EraseTimer() {
+    if ((chunk_state_ == ChunkState::kStream) && (erase_size_ < firmware_size_)) {
+        flashcode::Result result;
+        if (!EraseSectorPoll(result) || (flashcode::Result::kOk == result)) {
+            return;
+        }
+    }
+
+    // Done, or failed: WriteChunk erases (or reports the error) on demand
+    SoftwareTimerDelete(erase_timer_id_);
+}
+
+/*
+ * Erase whole sectors until [OFFSET_UIMAGE, OFFSET_UIMAGE + size) is erased.
+ * The sector size is asked per offset, the GD32F4xx sectors are not uniform.
+ */
+bool FlashCodeInstall::EraseAhead(uint32_t size) {
+    if (!IsFitting(size)) {
+        return false;
+    }
+
+    // Larger than announced with tsize
+    if ((firmware_size_ != 0) && (size > firmware_size_)) {
+        return false;
+    }
+
+    while (erase_size_ < size) {
+        if (!EraseSector()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+/*
+ * The image is written into the slot it is linked for (its reset handler),
+ * never into the slot that is running.
+ */
+bool FlashCodeInstall::SelectSlot(const uint8_t* chunck, uint32_t chunk_size) {
+    uint32_t vectors[2];
+
+    if (chunk_size < sizeof(vectors)) {
+        return false;
+    }
+
+    memcpy(vectors, chunck, sizeof(vectors));
+
+    const auto kSlot = bootcontrol::SlotOf(vectors[1]);
+
+    if ((kSlot == bootcontrol::Slot::kNone) || (kSlot == bootcontrol::SlotRunning())) {
+        puts("Error: the image is not linked for the inactive slot");
+        return false;
+    }
+
+    stream_offset_ = bootcontrol::SlotOffset(kSlot);
+
+    printf("Install into slot %c\n", kSlot == bootcontrol::Slot::kA ? 'A' : 'B');
+
+#if !defined(CONFIG_FIRMWARE_DELTA)
+    if ((firmware_size_ != 0) && (erase_timer_id_ == kTimerIdNone)) {
+        erase_timer_id_ = SoftwareTimerAdd(1, StaticCallbackFunctionEraseTimer);
+    }
+#endif
+
+    return true;
+}
+#endif
+
 bool FlashCodeInstall::WriteChunk(const uint8_t* chunck, uint32_t chunk_size, uint32_t& written) {
+#if defined(CONFIG_FIRMWARE_DELTA)
+    if (chunk_state_ == ChunkState::kDelta) {
+        if (!DeltaWrite(chunck, chunk_size)) {
+            written = write_count_;
+            return false;
+        }
+
+        write_count_ += chunk_size;
+        written = write_count_;
+        return true;
+    }
+#endif
+
+#if defined(CONFIG_FIRMWARE_LZ4)
+    if (is_lz4_) {
+        const auto kIsWritten = Lz4Write(chunck, chunk_size);
+
+        if (kIsWritten) {
+            input_count_ += chunk_size;
+        }
+
+        written = input_count_;
+        return kIsWritten;
+    }
+#endif
+
+    const auto kIsWritten = ImageWrite(chunck, chunk_size);
+    written = write_count_;
+    return kIsWritten;
+}
+
+/*
+ * Writes a chunk of the (decompressed) image at the write cursor.
+ */
+bool FlashCodeInstall::ImageWrite(const uint8_t* chunck, uint32_t chunk_size) {
+    uint32_t hold_size = 0;
+
+    if (chunk_state_ == ChunkState::kStream) {
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+        if ((write_count_ == 0) && !SelectSlot(chunck, chunk_size)) {
+            return false;
+        }
+#endif
+#if !defined(CONFIG_FIRMWARE_DELTA)
+        if (!EraseAhead(write_count_ + chunk_size) || !EraseWait()) {
+            return false;
+        }
+#endif
+
+        if (write_count_ == 0) {
+            if ((chunk_size <= kVectorTableHoldSize) || !firmware::firmware_install_start(chunck, chunk_size)) {
+                return false;
+            }
+
+            // Without a valid vector table the bootloader does not start the application
+            memcpy(vector_table_, chunck, kVectorTableHoldSize);
+            hold_size = kVectorTableHoldSize;
+        } else if (!firmware::firmware_install_continue(chunck, chunk_size)) {
+            return false;
+        }
+#if defined(CONFIG_FIRMWARE_DELTA)
+        return SectorStage(chunck, chunk_size);
+#endif
+    }
+
+#if defined(GD32)
+    const auto kMicros = timing::Micros();
+#endif
+
+    const auto kOffset = (chunk_state_ == ChunkState::kStream) ? stream_offset_ : OFFSET_UIMAGE;
+
     flashcode::Result result;
-    while (!FlashCode::Write(OFFSET_UIMAGE + write_count_, chunk_size, chunck, result)) {
+    while (!FlashCode::Write(kOffset + write_count_ + hold_size, chunk_size - hold_size, &chunck[hold_size], result)) {
         watchdog::Feed();
     }
 
+#if defined(GD32)
+    write_micros_ += timing::Micros() - kMicros;
+#endif
+
     write_count_ += chunk_size;
-    written = write_count_;
 
     if (write_count_ > erase_size_) {
         return false;
@@ -142,16 +505,95 @@ bool FlashCodeInstall::WriteChunk(const uint8_t* chunck, uint32_t chunk_size, ui
     return (flashcode::Result::kOk == result);
 }
 
+#if defined(CONFIG_FIRMWARE_LZ4)
+bool FlashCodeInstall::Lz4Write(const uint8_t* chunck, uint32_t chunk_size) {
+    if (lz4::Result::kError == s_lz4.Decode(chunck, chunk_size)) {
+        puts("Error: LZ4 frame");
+        return false;
+    }
+
+    if ((firmware_size_ == 0) && (s_lz4.GetContentSize() != 0)) {
+        return StreamReserve(s_lz4.GetContentSize());
+    }
+
+    return true;
+}
+
+/*
+ * A match before the decoder buffer: the staged sector, the held back vector table,
+ * or the image in flash.
+ */
+uint8_t FlashCodeInstall::Lz4History(uint32_t position) const {
+#if defined(CONFIG_FIRMWARE_DELTA)
+    // Staged, not yet in flash
+    if ((sector_size_ != 0) && (position >= sector_offset_)) {
+        return file_buffer_[position - sector_offset_];
+    }
+#endif
+    if (position < kVectorTableHoldSize) {
+        return vector_table_[position];
+    }
+#if defined(GD32)
+    return *reinterpret_cast<const uint8_t*>(FLASH_BASE + stream_offset_ + position);
+#else
+    uint8_t byte = 0xFF;
+    flashcode::Result result;
+    while (!FlashCode::Read(stream_offset_ + position, 1, &byte, result)) {
+    }
+    return byte;
+#endif
+}
+#endif
+
 bool FlashCodeInstall::WriteChunkComplete(uint32_t& write_count) {
     FLASHCODE_INSTALL_DEBUG_ENTRY();
 
+#if defined(CONFIG_FIRMWARE_LZ4)
+    if (is_lz4_) {
+        is_lz4_ = false;
+
+        // The rest of the image still in the decoder buffer
+        if (!s_lz4.Finish()) {
+            puts("Error: LZ4 frame is not complete");
+            write_count = input_count_;
+            write_count_ = 0;
+            chunk_state_ = ChunkState::kStart;
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+
+        printf("LZ4: %u -> %u bytes\n", static_cast<unsigned>(input_count_), static_cast<unsigned>(write_count_));
+    }
+#endif
+
     write_count = write_count_;
     const auto kWriteCount = write_count_;
     write_count_ = 0;
     const auto kState = chunk_state_;
     chunk_state_ = ChunkState::kStart;
 
-    if (kState != ChunkState::kWrite) {
+#if defined(CONFIG_FIRMWARE_DELTA)
+    if (kState == ChunkState::kDelta) {
+        const auto kIsDone = DeltaComplete();
+        FLASHCODE_INSTALL_DEBUG_EXIT();
+        return kIsDone;
+    }
+#endif
+
+    if (kState == ChunkState::kStream) {
+        if (erase_timer_id_ != kTimerIdNone) {
+            SoftwareTimerDelete(erase_timer_id_);
+        }
+
+        if (!EraseWait()) {
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+
+        if (firmware_size_ == 0) {
+            firmware_size_ = kWriteCount;
+        }
+    } else if (kState != ChunkState::kWrite) {
         FLASHCODE_INSTALL_DEBUG_EXIT();
         return false;
     }
@@ -161,6 +603,47 @@ bool FlashCodeInstall::WriteChunkComplete(uint32_t& write_count) {
         return false;
     }
 
+    if (kState == ChunkState::kStream) {
+        if (!firmware::firmware_install_end(nullptr, 0)) {
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+
+#if defined(CONFIG_FIRMWARE_DELTA)
+        // The last sector, erased beyond the image
+        image_size_ = kWriteCount;
+
+        if (!SectorCommit()) {
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+#endif
+
+        flashcode::Result result;
+        while (!FlashCode::Write(stream_offset_, kVectorTableHoldSize, vector_table_, result)) {
+            watchdog::Feed();
+        }
+
+        if (flashcode::Result::kError == result) {
+            puts("Error: flash write");
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+        if (!bootcontrol::Installed(stream_offset_ == OFFSET_UIMAGE_B ? bootcontrol::Slot::kB : bootcontrol::Slot::kA)) {
+            FLASHCODE_INSTALL_DEBUG_EXIT();
+            return false;
+        }
+#endif
+
+#if defined(CONFIG_FIRMWARE_DELTA)
+        printf("Image: %u bytes, %u sectors rewritten, %u unchanged\n", static_cast<unsigned>(kWriteCount), static_cast<unsigned>(sectors_rewritten_), static_cast<unsigned>(sectors_unchanged_));
+#elif defined(GD32)
+        printf("Program: %u bytes, %u us, %u kB/s\n", static_cast<unsigned>(kWriteCount), static_cast<unsigned>(write_micros_), static_cast<unsigned>(write_micros_ == 0 ? 0 : (kWriteCount * 1000U) / write_micros_));
+#endif
+    }
+
     FLASHCODE_INSTALL_DEBUG_EXIT();
     return true;
 }
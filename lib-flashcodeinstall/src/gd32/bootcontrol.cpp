@@ -0,0 +1,309 @@
+/**
+ * @file bootcontrol.cpp
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "bootcontrol.h"
+#include "firmware.h"
+#include "gd32.h"
+
+namespace bootcontrol {
+/*
+ * 16 bytes, appended to one of the two boot control sectors.
+ * A record that is not completely written fails the check.
+ */
+struct Record {
+    uint32_t magic;
+    uint8_t active;
+    uint8_t pending;
+    uint8_t tries; ///< Boots left for the pending slot
+    uint8_t reserved;
+    uint32_t sequence;
+    uint32_t check;
+};
+
+static_assert(sizeof(Record) == 16);
+static_assert((OFFSET_UIMAGE + FIRMWARE_MAX_SIZE) <= OFFSET_UIMAGE_B);
+static_assert((OFFSET_UIMAGE_B + FIRMWARE_MAX_SIZE) <= OFFSET_BOOTCONTROL);
+static_assert(OFFSET_BOOTCONTROL == 0x100000); // kSectorNumber
+
+static constexpr Slot kSlots[] = {Slot::kA, Slot::kB};
+static constexpr uint32_t kMagic = 0x4C544342; // "BCTL"
+/*
+ * Sector 12 (0x08100000 - 0x08103FFF) and 13 (0x08104000 - 0x08107FFF), the first 16K sectors of bank 1.
+ * The code runs from bank 0, it does not stall while they are erased.
+ * The FMC_CTL sector number of sector 12 is 16.
+ */
+static constexpr uint32_t kSectorNumber = 16;
+static constexpr uint32_t kSectors = 2;
+static constexpr uint32_t kSectorSize = 16 * 1024;
+static constexpr uint32_t kRecords = kSectorSize / sizeof(Record);
+
+/*
+ * Where the next record goes: after the newest record, in its sector.
+ */
+struct Position {
+    uint32_t sector;
+    uint32_t free_index;
+};
+
+static const Record* records(uint32_t sector) {
+    return reinterpret_cast<const Record*>(FLASH_BASE + OFFSET_BOOTCONTROL + sector * kSectorSize);
+}
+
+static uint32_t check(const Record& record) {
+    uint32_t word;
+    memcpy(&word, &record.active, sizeof(word));
+    return ~(record.magic ^ word ^ record.sequence);
+}
+
+static bool is_erased(const Record& record) {
+    const auto* words = reinterpret_cast<const uint32_t*>(&record);
+    return (words[0] & words[1] & words[2] & words[3]) == 0xFFFFFFFF;
+}
+
+/*
+ * The initial stack pointer in RAM, the reset handler a Thumb address inside the slot.
+ */
+static bool is_bootable(Slot slot) {
+    if (slot == Slot::kNone) {
+        return false;
+    }
+
+    const auto* vectors = reinterpret_cast<const uint32_t*>(FLASH_BASE + SlotOffset(slot));
+    const auto kStackPointer = vectors[0];
+    const auto kResetHandler = vectors[1];
+
+    if (((kStackPointer & 0x3) != 0) || (kStackPointer < 0x10000000) || (kStackPointer > 0x40000000)) {
+        return false;
+    }
+
+    return ((kResetHandler & 0x1) != 0) && (SlotOf(kResetHandler) == slot);
+}
+
+static Slot other(Slot slot) {
+    return (slot == Slot::kA) ? Slot::kB : Slot::kA;
+}
+
+/*
+ * The valid record with the highest sequence in both sectors, the position after it.
+ * Without a record, the first bootable slot is the active one.
+ */
+static Record read(Position& position) {
+    Record record{};
+    bool is_found = false;
+
+    position = {0, 0};
+
+    for (uint32_t sector = 0; sector < kSectors; sector++) {
+        const auto* entries = records(sector);
+        uint32_t free_index;
+
+        for (free_index = 0; free_index < kRecords; free_index++) {
+            const auto& entry = entries[free_index];
+
+            if (is_erased(entry)) {
+                break;
+            }
+
+            if ((entry.magic == kMagic) && (entry.check == check(entry)) && (!is_found || (entry.sequence > record.sequence))) {
+                record = entry;
+                is_found = true;
+                position.sector = sector;
+            }
+        }
+
+        if (position.sector == sector) {
+            position.free_index = free_index;
+        }
+    }
+
+    if (!is_found) {
+        record.magic = kMagic;
+        record.active = static_cast<uint8_t>(is_bootable(Slot::kB) && !is_bootable(Slot::kA) ? Slot::kB : Slot::kA);
+        record.pending = static_cast<uint8_t>(Slot::kNone);
+        record.tries = 0;
+        record.sequence = 0;
+    }
+
+    return record;
+}
+
+/*
+ * A full sector continues in the other one, that holds older records only.
+ * The sector with the newest record is never erased, a power loss leaves a valid record.
+ * Returns false when the FMC reports an error or the record does not read back.
+ */
+static bool write(Record& record, const Position& position) {
+    auto sector = position.sector;
+    auto free_index = position.free_index;
+
+    fmc_unlock();
+    fmc_flag_clear(FMC_FLAG_END | FMC_FLAG_OPERR | FMC_FLAG_WPERR | FMC_FLAG_PGMERR | FMC_FLAG_PGSERR);
+
+    if (free_index == kRecords) {
+        sector = (sector + 1) % kSectors;
+        free_index = 0;
+
+        if (fmc_sector_erase(CTL_SN(kSectorNumber + sector)) != FMC_READY) {
+            fmc_lock();
+            puts("Error: boot control erase");
+            return false;
+        }
+    }
+
+    record.magic = kMagic;
+    record.reserved = 0xFF;
+    record.sequence++;
+    record.check = check(record);
+
+    const auto* words = reinterpret_cast<const uint32_t*>(&record);
+    auto address = reinterpret_cast<uintptr_t>(&records(sector)[free_index]);
+
+    for (uint32_t i = 0; i < sizeof(Record) / 4; i++) {
+        if (fmc_word_program(static_cast<uint32_t>(address), words[i]) != FMC_READY) {
+            fmc_lock();
+            puts("Error: boot control write");
+            return false;
+        }
+        address += 4;
+    }
+
+    fmc_lock();
+
+    if (memcmp(&records(sector)[free_index], &record, sizeof(Record)) != 0) {
+        puts("Error: boot control verify");
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t SlotOffset(Slot slot) {
+    return (slot == Slot::kB) ? OFFSET_UIMAGE_B : OFFSET_UIMAGE;
+}
+
+Slot SlotOf(uint32_t address) {
+    for (const auto kSlot : kSlots) {
+        const auto kBase = FLASH_BASE + SlotOffset(kSlot);
+
+        if ((address > kBase) && (address < (kBase + FIRMWARE_MAX_SIZE))) {
+            return kSlot;
+        }
+    }
+
+    return Slot::kNone;
+}
+
+Slot SlotRunning() {
+    return SlotOf(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&SlotRunning)));
+}
+
+Slot Active() {
+    Position position;
+    return static_cast<Slot>(read(position).active);
+}
+
+Slot Select() {
+    Position position;
+    auto record = read(position);
+
+    const auto kPending = static_cast<Slot>(record.pending);
+
+    if (kPending != Slot::kNone) {
+        // A try that is not counted could boot the pending slot forever, it starts the active slot instead
+        if ((record.tries != 0) && is_bootable(kPending)) {
+            record.tries--;
+            if (write(record, position)) {
+                return kPending;
+            }
+        } else {
+            // Not confirmed in time: roll back
+            record.pending = static_cast<uint8_t>(Slot::kNone);
+            record.tries = 0;
+            write(record, position);
+        }
+    }
+
+    const auto kActive = static_cast<Slot>(record.active);
+
+    if (is_bootable(kActive)) {
+        return kActive;
+    }
+
+    if (is_bootable(other(kActive))) {
+        return other(kActive);
+    }
+
+    return Slot::kNone;
+}
+
+bool Installed(Slot slot) {
+    Position position;
+    auto record = read(position);
+
+    if (slot == static_cast<Slot>(record.active)) {
+        // Written in place (not running), there is nothing to fall back to
+        record.pending = static_cast<uint8_t>(Slot::kNone);
+        record.tries = 0;
+    } else {
+        record.pending = static_cast<uint8_t>(slot);
+        record.tries = kTries;
+    }
+
+    return write(record, position);
+}
+
+bool Confirm() {
+    const auto kRunning = SlotRunning();
+
+    if (kRunning == Slot::kNone) {
+        return false;
+    }
+
+    Position position;
+    auto record = read(position);
+
+    if (static_cast<Slot>(record.active) == kRunning) {
+        return true; // An image installed into the other slot stays pending
+    }
+
+    if (static_cast<Slot>(record.pending) != kRunning) {
+        return false;
+    }
+
+    record.active = static_cast<uint8_t>(kRunning);
+    record.pending = static_cast<uint8_t>(Slot::kNone);
+    record.tries = 0;
+
+    return write(record, position);
+}
+} // namespace bootcontrol
+
+#endif // CONFIG_FIRMWARE_AB_SLOTS
@@ -27,12 +27,34 @@
 #pragma GCC diagnostic ignored "-Wunused-private-field"
 #endif
 
+#include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <zlib.h>
 
 #include "flashcodeinstall.h"
+#include "firmware.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "bootcontrol.h"
+#endif
 #include "display.h"
+#include "watchdog.h"
+#include "gd32.h"
 #include "firmware/debug/debug_debug.h"
 
+#if defined(CONFIG_FIRMWARE_DELTA)
+/*
+ * One sector of the image being patched, the largest slot sector is 128K.
+ * A sector is erased as a whole, all of its base content must be in RAM before the erase:
+ * a smaller window cannot patch a 128K sector in place.
+ * RAM budget (GD32F450VI): this buffer, the ENET rings (about 37K) and the rest of .bss
+ * share the 256K RAMADD, the linker script asserts that they fit.
+ * Without CONFIG_FIRMWARE_DELTA there is no buffer, the streaming install does not need one.
+ */
+static constexpr uint32_t kSectorBufferSize = 128 * 1024;
+static uint8_t s_sector_buffer[kSectorBufferSize] __attribute__((aligned(4)));
+#endif
+
 FlashCodeInstall::FlashCodeInstall() {
     DEBUG_ENTRY();
 
@@ -42,6 +64,9 @@ FlashCodeInstall::FlashCodeInstall() {
     Display::Get()->Cls();
 
     flash_size_ = FlashCode::GetSize();
+#if defined(CONFIG_FIRMWARE_DELTA)
+    file_buffer_ = s_sector_buffer;
+#endif
 
     printf("FlashCodeInstall: %s, sector size %u, %u bytes [%u kB]\n", FlashCode::GetName(), static_cast<unsigned>(FlashCode::GetSectorSize()), static_cast<unsigned>(flash_size_), static_cast<unsigned>(flash_size_ / 1024U));
     Display::Get()->Write(1, FlashCode::GetName());
@@ -73,22 +98,389 @@ void FlashCodeInstall::Close() {
     DEBUG_EXIT();
 }
 
-bool FlashCodeInstall::BuffersCompare([[maybe_unused]] uint32_t size) {
-    DEBUG_ENTRY();
-    assert(0);
-    DEBUG_EXIT();
-    return false;
+/*
+ * The flash is memory mapped, flash_buffer_ points into it.
+ */
+bool FlashCodeInstall::BuffersCompare(uint32_t size) {
+    return memcmp(file_buffer_, flash_buffer_, size) == 0;
+}
+
+/*
+ * Returns true when the sector at offset differs from file_buffer_.
+ */
+bool FlashCodeInstall::Diff(uint32_t offset) {
+    flash_buffer_ = reinterpret_cast<uint8_t*>(FLASH_BASE + offset);
+    return !BuffersCompare(FlashCode::GetSectorSize(offset));
+}
+
+/*
+ * Erase the sector at offset and program it with file_buffer_.
+ */
+bool FlashCodeInstall::Write(uint32_t offset) {
+    DEBUG_PRINTF("offset=%x", static_cast<unsigned>(offset));
+
+    const auto kSectorSize = FlashCode::GetSectorSize(offset);
+
+    flashcode::Result result;
+    while (!FlashCode::Erase(offset, kSectorSize, result)) {
+        watchdog::Feed();
+    }
+
+    if (flashcode::Result::kError == result) {
+        puts("Error: flash erase");
+        return false;
+    }
+
+    while (!FlashCode::Write(offset, kSectorSize, file_buffer_, result)) {
+        watchdog::Feed();
+    }
+
+    if (flashcode::Result::kError == result) {
+        puts("Error: flash write");
+        return false;
+    }
+
+    return true;
 }
 
-bool FlashCodeInstall::Diff([[maybe_unused]] uint32_t offset) {
+#if defined(CONFIG_FIRMWARE_DELTA)
+bool FlashCodeInstall::DeltaStart() {
     DEBUG_ENTRY();
-    assert(0);
+
+    if (!StreamStart()) {
+        DEBUG_EXIT();
+        return false;
+    }
+
+    chunk_state_ = ChunkState::kDelta;
+    delta_state_ = DeltaState::kHeader;
+    delta_count_ = 0;
+    delta_position_ = 0;
+
     DEBUG_EXIT();
-    return false;
+    return true;
+}
+
+bool FlashCodeInstall::DeltaWrite(const uint8_t* data, uint32_t size) {
+    while (size != 0) {
+        if (delta_state_ == DeltaState::kData) {
+            if (!DeltaSeek(delta_position_)) {
+                return false;
+            }
+
+            auto count = sector_offset_ + sector_size_ - delta_position_;
+            if (count > delta_patch_.length) {
+                count = delta_patch_.length;
+            }
+            if (count > size) {
+                count = size;
+            }
+
+            memcpy(&file_buffer_[delta_position_ - sector_offset_], data, count);
+
+            data += count;
+            size -= count;
+            delta_position_ += count;
+            delta_patch_.length -= count;
+
+            if (delta_patch_.length == 0) {
+                delta_state_ = DeltaState::kPatch;
+            }
+
+            continue;
+        }
+
+        const auto kIsHeader = (delta_state_ == DeltaState::kHeader);
+        auto* record = kIsHeader ? reinterpret_cast<uint8_t*>(&delta_header_) : reinterpret_cast<uint8_t*>(&delta_patch_);
+        const auto kRecordSize = static_cast<uint32_t>(kIsHeader ? sizeof(delta_header_) : sizeof(delta_patch_));
+
+        auto count = kRecordSize - delta_count_;
+        if (count > size) {
+            count = size;
+        }
+
+        memcpy(&record[delta_count_], data, count);
+
+        data += count;
+        size -= count;
+        delta_count_ += count;
+
+        if (delta_count_ != kRecordSize) {
+            continue;
+        }
+
+        delta_count_ = 0;
+
+        if (kIsHeader) {
+            if (!DeltaHeader()) {
+                return false;
+            }
+
+            delta_state_ = DeltaState::kPatch;
+            continue;
+        }
+
+        // The patches are in ascending order and do not overlap
+        if ((delta_patch_.length == 0) || (delta_patch_.offset < delta_position_) || (delta_patch_.offset > delta_header_.size) ||
+            (delta_patch_.length > (delta_header_.size - delta_patch_.offset))) {
+            puts("Error: delta patch");
+            return false;
+        }
+
+        delta_position_ = delta_patch_.offset;
+        delta_state_ = DeltaState::kData;
+    }
+
+    return true;
+}
+
+/*
+ * The delta must be made against the image that is installed in the slot.
+ */
+bool FlashCodeInstall::DeltaHeader() {
+    DEBUG_PRINTF("offset=%x, base_size=%u, size=%u", static_cast<unsigned>(delta_header_.offset), static_cast<unsigned>(delta_header_.base_size), static_cast<unsigned>(delta_header_.size));
+
+    if (delta_header_.magic != firmware::delta::kMagic) {
+        puts("Error: no delta image");
+        return false;
+    }
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    const auto kSlot = bootcontrol::SlotOf(FLASH_BASE + delta_header_.offset + kVectorTableHoldSize);
+
+    if ((kSlot == bootcontrol::Slot::kNone) || (bootcontrol::SlotOffset(kSlot) != delta_header_.offset) || (kSlot == bootcontrol::SlotRunning())) {
+        puts("Error: delta slot");
+        return false;
+    }
+#else
+    if (delta_header_.offset != OFFSET_UIMAGE) {
+        puts("Error: delta slot");
+        return false;
+    }
+#endif
+
+    if ((delta_header_.size <= kVectorTableHoldSize) || (delta_header_.size > FIRMWARE_MAX_SIZE) || (delta_header_.base_size > FIRMWARE_MAX_SIZE)) {
+        puts("Error: delta size");
+        return false;
+    }
+
+    const auto* base = reinterpret_cast<const uint8_t*>(FLASH_BASE + delta_header_.offset);
+
+    if (crc32(0, base, delta_header_.base_size) != delta_header_.base_crc) {
+        puts("Error: delta base image does not match");
+        return false;
+    }
+
+    stream_offset_ = delta_header_.offset;
+    image_size_ = delta_header_.size;
+    return true;
 }
 
-void FlashCodeInstall::Write([[maybe_unused]] uint32_t offset) {
+/*
+ * The sectors are walked in order from the start of the image,
+ * each one is committed before the next one is loaded.
+ */
+bool FlashCodeInstall::DeltaSeek(uint32_t offset) {
+    if (sector_size_ == 0) {
+        return SectorLoad(0, true) && DeltaSeek(offset);
+    }
+
+    while (offset >= (sector_offset_ + sector_size_)) {
+        if (!SectorCommit() || !SectorLoad(sector_offset_ + sector_size_, true)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FlashCodeInstall::DeltaComplete() {
     DEBUG_ENTRY();
-    assert(0);
+
+    if ((delta_state_ != DeltaState::kPatch) || (delta_count_ != 0)) {
+        puts("Error: delta is incomplete");
+        DEBUG_EXIT();
+        return false;
+    }
+
+    const auto kEnd = delta_header_.size > delta_header_.base_size ? delta_header_.size : delta_header_.base_size;
+
+    if (!DeltaSeek(kEnd - 1) || !SectorCommit()) {
+        DEBUG_EXIT();
+        return false;
+    }
+
+    const auto* image = reinterpret_cast<const uint8_t*>(FLASH_BASE + stream_offset_);
+    auto crc = crc32(0, vector_table_, kVectorTableHoldSize);
+    crc = crc32(crc, &image[kVectorTableHoldSize], delta_header_.size - kVectorTableHoldSize);
+
+    if (crc != delta_header_.crc) {
+        printf("Error: delta CRC %x != %x\n", static_cast<unsigned>(crc), static_cast<unsigned>(delta_header_.crc));
+        DEBUG_EXIT();
+        return false;
+    }
+
+    if (!DeltaVerify()) {
+        DEBUG_EXIT();
+        return false;
+    }
+
+    flashcode::Result result;
+    while (!FlashCode::Write(stream_offset_, kVectorTableHoldSize, vector_table_, result)) {
+        watchdog::Feed();
+    }
+
+    if (flashcode::Result::kError == result) {
+        puts("Error: flash write");
+        DEBUG_EXIT();
+        return false;
+    }
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    if (!bootcontrol::Installed(stream_offset_ == OFFSET_UIMAGE_B ? bootcontrol::Slot::kB : bootcontrol::Slot::kA)) {
+        DEBUG_EXIT();
+        return false;
+    }
+#endif
+
+    printf("Delta: %u bytes, %u sectors rewritten, %u unchanged\n", static_cast<unsigned>(delta_header_.size), static_cast<unsigned>(sectors_rewritten_), static_cast<unsigned>(sectors_unchanged_));
+
     DEBUG_EXIT();
+    return true;
+}
+
+/*
+ * The reconstructed image gets the checks of a full image upload: the vector table
+ * (firmware::image::is_valid) and the image info, size and CRC32 (firmware_install_end).
+ * The vector table is still held back, the start of the image is put together from it.
+ */
+bool FlashCodeInstall::DeltaVerify() {
+    const auto* image = reinterpret_cast<const uint8_t*>(FLASH_BASE + stream_offset_);
+    uint8_t head[firmware::image::kInfoOffset + firmware::image::kInfoSize];
+    static_assert(sizeof(head) > kVectorTableHoldSize);
+
+    if (delta_header_.size < sizeof(head)) {
+        puts("Error: delta image is too small");
+        return false;
+    }
+
+    memcpy(head, vector_table_, kVectorTableHoldSize);
+    memcpy(&head[kVectorTableHoldSize], &image[kVectorTableHoldSize], sizeof(head) - kVectorTableHoldSize);
+
+    if (!firmware::image::is_valid(head)) {
+        puts("Error: delta image vector table");
+        return false;
+    }
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    // Linked for the slot it is patched in
+    uint32_t reset_handler;
+    memcpy(&reset_handler, &head[4], sizeof(reset_handler));
+
+    if (bootcontrol::SlotOffset(bootcontrol::SlotOf(reset_handler)) != stream_offset_) {
+        puts("Error: delta image is linked for the other slot");
+        return false;
+    }
+#endif
+
+    return firmware::firmware_install_start(head, sizeof(head)) && firmware::firmware_install_end(&image[sizeof(head)], delta_header_.size - static_cast<uint32_t>(sizeof(head)));
 }
+
+/*
+ * Full image install, compare before erase: the image is staged sector by sector,
+ * a sector is committed when the next one starts, the last one by WriteChunkComplete.
+ * Only a sector with a changed content is erased and programmed.
+ */
+bool FlashCodeInstall::SectorStage(const uint8_t* data, uint32_t size) {
+    const auto kEnd = write_count_ + size;
+
+    if (!IsFitting(kEnd)) {
+        return false;
+    }
+
+    // Larger than announced with tsize
+    if ((firmware_size_ != 0) && (kEnd > firmware_size_)) {
+        return false;
+    }
+
+    while (size != 0) {
+        if (sector_size_ == 0) {
+            if (!SectorLoad(0, false)) {
+                return false;
+            }
+        } else if (write_count_ == (sector_offset_ + sector_size_)) {
+            if (!SectorCommit() || !SectorLoad(sector_offset_ + sector_size_, false)) {
+                return false;
+            }
+        }
+
+        auto count = sector_offset_ + sector_size_ - write_count_;
+        if (count > size) {
+            count = size;
+        }
+
+        memcpy(&file_buffer_[write_count_ - sector_offset_], data, count);
+
+        data += count;
+        size -= count;
+        write_count_ += count;
+    }
+
+    return true;
+}
+
+/*
+ * With is_base the installed content, without what is beyond the base image.
+ * Otherwise an erased sector, to be filled by SectorStage.
+ */
+bool FlashCodeInstall::SectorLoad(uint32_t offset, bool is_base) {
+    sector_offset_ = offset;
+    sector_size_ = FlashCode::GetSectorSize(stream_offset_ + offset);
+
+    if (sector_size_ > kSectorBufferSize) {
+        puts("Error: sector size");
+        return false;
+    }
+
+    if (!is_base) {
+        memset(file_buffer_, 0xFF, sector_size_);
+        return true;
+    }
+
+    memcpy(file_buffer_, reinterpret_cast<const uint8_t*>(FLASH_BASE + stream_offset_ + offset), sector_size_);
+
+    if (delta_header_.base_size < (offset + sector_size_)) {
+        const auto kFrom = delta_header_.base_size > offset ? delta_header_.base_size - offset : 0;
+        memset(&file_buffer_[kFrom], 0xFF, sector_size_ - kFrom);
+    }
+
+    return true;
+}
+
+/*
+ * The first sector is always rewritten with its vector table erased:
+ * an interrupted update does not leave a bootable, half patched image.
+ */
+bool FlashCodeInstall::SectorCommit() {
+    if (image_size_ < (sector_offset_ + sector_size_)) {
+        const auto kFrom = image_size_ > sector_offset_ ? image_size_ - sector_offset_ : 0;
+        memset(&file_buffer_[kFrom], 0xFF, sector_size_ - kFrom);
+    }
+
+    const auto kOffset = stream_offset_ + sector_offset_;
+
+    if (sector_offset_ == 0) {
+        memcpy(vector_table_, file_buffer_, kVectorTableHoldSize);
+        memset(file_buffer_, 0xFF, kVectorTableHoldSize);
+    } else if (!Diff(kOffset)) {
+        sectors_unchanged_++;
+        return true;
+    }
+
+    sectors_rewritten_++;
+
+    Display::Get()->Progress();
+
+    return Write(kOffset);
+}
+#endif
@@ -0,0 +1,290 @@
+/**
+ * @file lz4frame.cpp
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+
+#include "lz4frame.h"
+
+/*
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ * The xxHash32 checksums (header, blocks, content) are skipped,
+ * the firmware image has its own CRC32.
+ */
+
+namespace lz4 {
+namespace flags {
+inline constexpr uint8_t kVersionMask = 0xC0;
+inline constexpr uint8_t kVersion = 0x40;
+inline constexpr uint8_t kBlockChecksum = 0x10;
+inline constexpr uint8_t kContentSize = 0x08;
+inline constexpr uint8_t kContentChecksum = 0x04;
+inline constexpr uint8_t kDictionaryId = 0x01;
+} // namespace flags
+namespace bd {
+inline constexpr uint8_t kBlockMaxSizeShift = 4;
+inline constexpr uint8_t kBlockMaxSizeMask = 0x07;
+inline constexpr uint8_t kBlockMaxSizeMin = 4; ///< 64K, 5 is 256K, 6 is 1M, 7 is 4M
+inline constexpr uint8_t kReservedMask = 0x8F;
+} // namespace bd
+
+static constexpr uint32_t kMinMatch = 4;
+
+void Frame::Init(Flush flush, History history) {
+    flush_ = flush;
+    history_ = history;
+    value_ = 0;
+    count_ = 0;
+    content_size_ = 0;
+    out_count_ = 0;
+    flushed_ = 0;
+    state_ = State::kMagic;
+}
+
+bool Frame::Put(uint8_t byte) {
+    buffer_[out_count_ - flushed_] = byte;
+    out_count_++;
+
+    if ((out_count_ - flushed_) == kBufferSize) {
+        if (!flush_(buffer_, kBufferSize)) {
+            return false;
+        }
+        flushed_ = out_count_;
+    }
+
+    return true;
+}
+
+bool Frame::Copy() {
+    // The source can overlap the bytes being copied (offset < length)
+    auto position = out_count_ - value_;
+
+    while (length_ != 0) {
+        const auto kByte = (position >= flushed_) ? buffer_[position - flushed_] : history_(position);
+        if (!Put(kByte)) {
+            return false;
+        }
+        position++;
+        length_--;
+    }
+
+    return true;
+}
+
+void Frame::AfterLiterals() {
+    if (block_size_ == 0) {
+        EndBlock();
+        return;
+    }
+
+    value_ = 0;
+    count_ = 0;
+    state_ = State::kOffset;
+}
+
+void Frame::EndBlock() {
+    value_ = 0;
+    count_ = 0;
+    state_ = (flags_ & flags::kBlockChecksum) ? State::kBlockChecksum : State::kBlockSize;
+}
+
+Result Frame::Decode(const uint8_t* data, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        const auto kByte = data[i];
+
+        switch (state_) {
+            case State::kMagic:
+                value_ |= static_cast<uint32_t>(kByte) << (8 * count_);
+                if (++count_ == 4) {
+                    if (value_ != kFrameMagic) {
+                        state_ = State::kError;
+                        return Result::kError;
+                    }
+                    state_ = State::kFlags;
+                }
+                break;
+            case State::kFlags:
+                if (((kByte & flags::kVersionMask) != flags::kVersion) || (kByte & flags::kDictionaryId)) {
+                    state_ = State::kError;
+                    return Result::kError;
+                }
+                flags_ = kByte;
+                state_ = State::kBlockDescriptor;
+                break;
+            case State::kBlockDescriptor: {
+                const auto kBlockMaxSize = static_cast<uint32_t>((kByte >> bd::kBlockMaxSizeShift) & bd::kBlockMaxSizeMask);
+                if (((kByte & bd::kReservedMask) != 0) || (kBlockMaxSize < bd::kBlockMaxSizeMin)) {
+                    state_ = State::kError;
+                    return Result::kError;
+                }
+                block_max_size_ = 1U << (2 * kBlockMaxSize + 8);
+                // Content size (optional) and the header checksum
+                header_size_ = ((flags_ & flags::kContentSize) ? 8U : 0U) + 1U;
+                count_ = 0;
+                state_ = State::kHeader;
+                break;
+            }
+            case State::kHeader:
+                if ((flags_ & flags::kContentSize) && (count_ < 4)) {
+                    content_size_ |= static_cast<uint32_t>(kByte) << (8 * count_);
+                } else if ((flags_ & flags::kContentSize) && (count_ < 8) && (kByte != 0)) {
+                    state_ = State::kError; // Does not fit in 32 bits
+                    return Result::kError;
+                }
+                if (++count_ == header_size_) {
+                    value_ = 0;
+                    count_ = 0;
+                    state_ = State::kBlockSize;
+                }
+                break;
+            case State::kBlockSize:
+                value_ |= static_cast<uint32_t>(kByte) << (8 * count_);
+                if (++count_ == 4) {
+                    if (value_ == 0) { // End mark
+                        count_ = 0;
+                        state_ = (flags_ & flags::kContentChecksum) ? State::kContentChecksum : State::kEnd;
+                        break;
+                    }
+                    block_size_ = value_ & 0x7FFFFFFF;
+                    // An empty raw block (0x80000000) would underflow block_size_
+                    if ((block_size_ == 0) || (block_size_ > block_max_size_)) {
+                        state_ = State::kError;
+                        return Result::kError;
+                    }
+                    state_ = (value_ & 0x80000000) ? State::kRaw : State::kToken;
+                }
+                break;
+            case State::kRaw:
+                if (!Put(kByte)) {
+                    state_ = State::kError;
+                    return Result::kError;
+                }
+                if (--block_size_ == 0) {
+                    EndBlock();
+                }
+                break;
+            case State::kToken:
+                block_size_--;
+                length_ = kByte >> 4;
+                match_ = kByte & 0x0F;
+                if (length_ == 15) {
+                    state_ = State::kLiteralLength;
+                } else if (length_ != 0) {
+                    state_ = State::kLiterals;
+                } else {
+                    AfterLiterals();
+                }
+                break;
+            case State::kLiteralLength:
+                block_size_--;
+                length_ += kByte;
+                if (kByte != 255) {
+                    state_ = State::kLiterals;
+                }
+                break;
+            case State::kLiterals:
+                block_size_--;
+                if (!Put(kByte)) {
+                    state_ = State::kError;
+                    return Result::kError;
+                }
+                if (--length_ == 0) {
+                    AfterLiterals();
+                }
+                break;
+            case State::kOffset:
+                block_size_--;
+                value_ |= static_cast<uint32_t>(kByte) << (8 * count_);
+                if (++count_ == 2) {
+                    if ((value_ == 0) || (value_ > out_count_)) {
+                        state_ = State::kError;
+                        return Result::kError;
+                    }
+                    length_ = match_ + kMinMatch;
+                    if (match_ == 15) {
+                        state_ = State::kMatchLength;
+                        break;
+                    }
+                    if (!Copy()) {
+                        state_ = State::kError;
+                        return Result::kError;
+                    }
+                    state_ = State::kToken;
+                }
+                break;
+            case State::kMatchLength:
+                block_size_--;
+                length_ += kByte;
+                if (kByte != 255) {
+                    if (!Copy()) {
+                        state_ = State::kError;
+                        return Result::kError;
+                    }
+                    state_ = State::kToken;
+                }
+                break;
+            case State::kBlockChecksum:
+                if (++count_ == 4) {
+                    value_ = 0;
+                    count_ = 0;
+                    state_ = State::kBlockSize;
+                }
+                break;
+            case State::kContentChecksum:
+                if (++count_ == 4) {
+                    state_ = State::kEnd;
+                }
+                break;
+            case State::kEnd:
+            case State::kError:
+                // Data after the end of the frame
+                state_ = State::kError;
+                return Result::kError;
+        }
+
+        // A block ends with literals, never within a sequence
+        if ((block_size_ == 0) && ((state_ == State::kToken) || (state_ == State::kLiteralLength) || (state_ == State::kLiterals) || (state_ == State::kOffset) || (state_ == State::kMatchLength))) {
+            state_ = State::kError;
+            return Result::kError;
+        }
+    }
+
+    return (state_ == State::kEnd) ? Result::kDone : Result::kContinue;
+}
+
+bool Frame::Finish() {
+    if (state_ != State::kEnd) {
+        return false;
+    }
+
+    if (out_count_ != flushed_) {
+        if (!flush_(buffer_, out_count_ - flushed_)) {
+            return false;
+        }
+        flushed_ = out_count_;
+    }
+
+    return true;
+}
+} // namespace lz4
@@ -59,6 +59,10 @@ OF SUCH DAMAGE.
 #define ENET_TXBUF_SIZE                  ENET_MAX_FRAME_SIZE                    /*!< ethernet transmit buffer size */
 #endif
 
+#ifndef ENET_DMA_SECTION
+#define ENET_DMA_SECTION                                                        /*!< section of the descriptors and buffers */
+#endif
+
 //#define SELECT_DESCRIPTORS_ENHANCED_MODE 
 
 //#define USE_DELAY
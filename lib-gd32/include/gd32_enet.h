@@ -257,6 +257,18 @@ template <uint32_t feature> inline void FilterFeatureEnable() {
 }
 #endif
 
+#if defined(GD32H7XX)
+inline void WriteHash(uint32_t hash_low, uint32_t hash_high) {
+    ENET_MAC_HLH(ENETx) = hash_high;
+    ENET_MAC_HLL(ENETx) = hash_low;
+}
+#else
+inline void WriteHash(uint32_t hash_low, uint32_t hash_high) {
+    ENET_MAC_HLH = hash_high;
+    ENET_MAC_HLL = hash_low;
+}
+#endif
+
 #if defined(GD32H7XX)
 inline void FilterSetHash(uint32_t hash) {
     if (hash > 31) {
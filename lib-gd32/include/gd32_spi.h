@@ -52,6 +52,7 @@ void Gd32SpiBegin();
 void Gd32SpiEnd();
 
 void Gd32SpiSetSpeedHz(uint32_t speed_hz);
+uint32_t Gd32SpiGetSpeedHz();
 void Gd32SpiSetDataMode(uint8_t mode);
 void Gd32SpiChipSelect(uint8_t chip_select);
 
@@ -62,12 +63,15 @@ void Gd32SpiWrite(uint16_t data);
 void Gd32SpiWritenb(const char* tx_buffer, uint32_t length);
 
 /*
- * DMA support
+ * DMA support, full duplex with the TX and the RX channel (SPI_DMA_RX_CHx)
+ * The completion is polled, CS is handled by the user application.
+ * Without a tx_buffer 0xFF is sent, without a rx_buffer the received bytes are discarded.
+ * The buffers must be DMA accessible, not in the TCMSRAM.
  */
 
-// const uint8_t* Gd32SpiDmaTxPrepare(uint32_t& length);
-// void Gd32SpiDmaTxStart(const uint8_t* tx_buffer, uint32_t length);
-// bool Gd32SpiDmaTxIsActive();
+void Gd32SpiDmaBegin();
+void Gd32SpiDmaTransferStart(const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t length);
+bool Gd32SpiDmaIsActive();
 
 /**
  * SPI DMA implementation using I2S.
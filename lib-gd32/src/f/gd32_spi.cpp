@@ -129,33 +129,35 @@ void Gd32SpiEnd() {
 #endif
 }
 
-void Gd32SpiSetSpeedHz(uint32_t speed_hz) {
-    assert(speed_hz != 0);
-
-    uint32_t div;
-
+static constexpr uint32_t GetPclk() {
     if constexpr (SPI_PERIPH == SPI0) {
-        div = APB2_CLOCK_FREQ / speed_hz; ///< PCLK2 when using SPI0
+        return APB2_CLOCK_FREQ; ///< PCLK2 when using SPI0
     } else {
-        div = APB1_CLOCK_FREQ / speed_hz; ///< PCLK1 when using SPI1 and SPI2
+        return APB1_CLOCK_FREQ; ///< PCLK1 when using SPI1 and SPI2
     }
+}
+
+void Gd32SpiSetSpeedHz(uint32_t speed_hz) {
+    assert(speed_hz != 0);
+
+    const auto kDiv = GetPclk() / speed_hz;
 
     uint32_t ctl0 = SPI_CTL0(SPI_PERIPH);
     ctl0 &= ~CTL0_PSC(7);
 
-    if (div <= 2) {
+    if (kDiv <= 2) {
         ctl0 |= SPI_PSC_2;
-    } else if (div <= 4) {
+    } else if (kDiv <= 4) {
         ctl0 |= SPI_PSC_4;
-    } else if (div <= 8) {
+    } else if (kDiv <= 8) {
         ctl0 |= SPI_PSC_8;
-    } else if (div <= 16) {
+    } else if (kDiv <= 16) {
         ctl0 |= SPI_PSC_16;
-    } else if (div <= 32) {
+    } else if (kDiv <= 32) {
         ctl0 |= SPI_PSC_32;
-    } else if (div <= 64) {
+    } else if (kDiv <= 64) {
         ctl0 |= SPI_PSC_64;
-    } else if (div <= 128) {
+    } else if (kDiv <= 128) {
         ctl0 |= SPI_PSC_128;
     } else {
         ctl0 |= SPI_PSC_256;
@@ -166,6 +168,11 @@ void Gd32SpiSetSpeedHz(uint32_t speed_hz) {
     spi_enable(SPI_PERIPH);
 }
 
+uint32_t Gd32SpiGetSpeedHz() {
+    const auto kPsc = (SPI_CTL0(SPI_PERIPH) & CTL0_PSC(7)) >> 3;
+    return GetPclk() / (2U << kPsc);
+}
+
 void Gd32SpiSetDataMode(uint8_t mode) {
     uint32_t ctl0 = SPI_CTL0(SPI_PERIPH);
     ctl0 &= static_cast<uint32_t>(~0x3);
@@ -0,0 +1,139 @@
+/**
+ * @file gd32_spi_dma.cpp
+ *
+ */
+/* Copyright (C) 2026 by Arjan van Vught mailto:info@gd32-dmx.org
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cassert>
+
+#include "gd32_spi.h"
+#include "gd32.h"
+
+#if defined(GD32F4XX) && defined(SPI_DMA_RX_CHx)
+
+static_assert(SPI_DMA_RX_CHx != SPI_DMA_CHx);
+
+/*
+ * Without a buffer the memory address is not increased:
+ * the TX channel sends s_tx_dummy, the RX channel overwrites s_rx_dummy.
+ */
+static uint8_t s_tx_dummy = 0xFF;
+static uint8_t s_rx_dummy;
+
+template <dma_channel_enum channel> static void DmaConfig(dma_subperipheral_enum sub_periph, uint32_t direction) {
+    dma_deinit(SPI_DMAx, channel);
+
+    dma_single_data_parameter_struct dma_init_struct;
+    dma_single_data_para_struct_init(&dma_init_struct);
+
+    dma_init_struct.direction = direction;
+    dma_init_struct.memory_inc = DMA_MEMORY_INCREASE_ENABLE;
+    dma_init_struct.periph_addr = SPI_PERIPH + 0x0CU;
+    dma_init_struct.periph_inc = DMA_PERIPH_INCREASE_DISABLE;
+    dma_init_struct.periph_memory_width = DMA_PERIPH_WIDTH_8BIT;
+    dma_init_struct.priority = DMA_PRIORITY_HIGH;
+    dma_single_data_mode_init(SPI_DMAx, channel, &dma_init_struct);
+
+    dma_circulation_disable(SPI_DMAx, channel);
+    dma_channel_subperipheral_select(SPI_DMAx, channel, sub_periph);
+
+    DMA_CHCNT(SPI_DMAx, channel) = 0;
+}
+
+template <dma_channel_enum channel> static void DmaStart(uint32_t memory_address, bool memory_increase, uint32_t length) {
+    dma_flag_clear(SPI_DMAx, channel, DMA_FLAG_FTF | DMA_FLAG_HTF | DMA_FLAG_TAE | DMA_FLAG_SDE | DMA_FLAG_FEE);
+
+    auto dma_ch_ctl = DMA_CHCTL(SPI_DMAx, channel);
+    dma_ch_ctl &= ~DMA_CHXCTL_CHEN;
+    DMA_CHCTL(SPI_DMAx, channel) = dma_ch_ctl;
+
+    if (memory_increase) {
+        dma_ch_ctl |= DMA_CHXCTL_MNAGA;
+    } else {
+        dma_ch_ctl &= ~DMA_CHXCTL_MNAGA;
+    }
+
+    DMA_CHM0ADDR(SPI_DMAx, channel) = memory_address;
+    DMA_CHCNT(SPI_DMAx, channel) = (length & DMA_CHXCNT_CNT);
+    dma_ch_ctl |= DMA_CHXCTL_CHEN;
+    DMA_CHCTL(SPI_DMAx, channel) = dma_ch_ctl;
+}
+
+static inline bool IsDmaAccessible(const void* buffer) {
+    const auto kAddress = reinterpret_cast<uint32_t>(buffer);
+    return (kAddress < TCMSRAM_BASE) || (kAddress >= (TCMSRAM_BASE + (64U * 1024U)));
+}
+
+void Gd32SpiDmaBegin() {
+    if (SPI_DMAx == DMA0) {
+        rcu_periph_clock_enable(RCU_DMA0);
+    } else {
+        rcu_periph_clock_enable(RCU_DMA1);
+    }
+
+    DmaConfig<SPI_DMA_RX_CHx>(SPI_DMA_RX_SUBPERIx, DMA_PERIPH_TO_MEMORY);
+    DmaConfig<SPI_DMA_CHx>(SPI_DMA_SUBPERIx, DMA_MEMORY_TO_PERIPH);
+}
+
+void Gd32SpiDmaTransferStart(const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t length) {
+    assert(length != 0);
+    assert(length <= DMA_CHXCNT_CNT);
+    assert(IsDmaAccessible(tx_buffer));
+    assert(IsDmaAccessible(rx_buffer));
+
+    // A byte left from a transmit only transfer
+    while (RESET != (SPI_STAT(SPI_PERIPH) & SPI_FLAG_RBNE)) {
+        static_cast<void>(SPI_DATA(SPI_PERIPH));
+    }
+
+    // The RX channel first, it must be ready for the first byte clocked in
+    if (rx_buffer != nullptr) {
+        DmaStart<SPI_DMA_RX_CHx>(reinterpret_cast<uint32_t>(rx_buffer), true, length);
+    } else {
+        DmaStart<SPI_DMA_RX_CHx>(reinterpret_cast<uint32_t>(&s_rx_dummy), false, length);
+    }
+
+    if (tx_buffer != nullptr) {
+        DmaStart<SPI_DMA_CHx>(reinterpret_cast<uint32_t>(tx_buffer), true, length);
+    } else {
+        DmaStart<SPI_DMA_CHx>(reinterpret_cast<uint32_t>(&s_tx_dummy), false, length);
+    }
+
+    spi_dma_enable(SPI_PERIPH, SPI_DMA_RECEIVE);
+    spi_dma_enable(SPI_PERIPH, SPI_DMA_TRANSMIT);
+}
+
+/**
+ * The transfer is done when the last byte is received, the SPI is idle then.
+ */
+bool Gd32SpiDmaIsActive() {
+    if (DMA_CHCNT(SPI_DMAx, SPI_DMA_RX_CHx) != 0) {
+        return true;
+    }
+
+    spi_dma_disable(SPI_PERIPH, SPI_DMA_TRANSMIT);
+    spi_dma_disable(SPI_PERIPH, SPI_DMA_RECEIVE);
+
+    return false;
+}
+#endif
@@ -70,6 +70,14 @@
 # error
 #endif
 
+/*
+ * Ports in network::udp::Mode::kCopy need a datagram buffer each,
+ * zero-copy ports do not.
+ */
+#if !defined (UDP_MAX_COPY_PORTS)
+# define UDP_MAX_COPY_PORTS				UDP_MAX_PORTS_ALLOWED
+#endif
+
 #if !defined (IGMP_MAX_JOINS_ALLOWED)
 # error
 #endif
@@ -29,6 +29,8 @@
 #include <cstdint>
 #include <cstddef>
 
+#include "softwaretimers.h"
+
 namespace tftp {
 enum class Mode { kBinary, kAscii };
 } // namespace tftp
@@ -46,34 +48,84 @@ class TFTPDaemon {
     virtual size_t FileRead(void* buffer, size_t count, unsigned block_number) = 0;
     virtual size_t FileWrite(const void* buffer, size_t count, unsigned block_number) = 0;
 
+    /**
+     * @brief WRQ with the tsize option, called after FileCreate.
+     * @return false when a file of size bytes does not fit, the request is rejected.
+     */
+    virtual bool FileReserve([[maybe_unused]] uint32_t size) { return true; }
+    /**
+     * @brief RRQ with the tsize option, called after FileOpen.
+     * @return file size, 0 when not known.
+     */
+    virtual uint32_t FileSize() { return 0; }
+    /**
+     * @brief The transfer is aborted after too many retransmissions.
+     */
+    virtual void FileAbort() {}
+    /**
+     * @brief The negotiated blksize is rounded down to a multiple of it, FileWrite offsets are then aligned.
+     * @return power of 2, not larger than 64 (the smallest blksize accepted).
+     */
+    virtual uint32_t FileBlockAlign() const { return 1; }
+
     virtual void Exit() = 0;
 
+    /**
+     * @brief Negotiated data length per block (blksize option), 512 by default.
+     */
+    [[nodiscard]] uint16_t GetBlockSize() const { return block_size_; }
+
    private:
     void Init();
     void HandleRequest();
     void HandleRecvAck();
     void HandleRecvData();
+    void HandleOptions(const char* options);
     void SendError(uint16_t error_code, const char* error_message);
+    void SendOptionAck();
     void DoRead();
+    void SendWindow();
     void DoWriteAck();
+    void UpdateRto();
+    void Timer();
+    void ResumeTimer();
 
    private:
-    enum class State { kInit, kWaitingRq, kRrqSendPacket, kRrqRecvAck, kWrqSendAck, kWrqRecvPacket };
+    enum class State { kInit, kWaitingRq, kRrqRecvAck, kWrqSendAck, kWrqRecvPacket };
     State state_{State::kInit};
     int32_t index_{-1};
-    uint8_t* buffer_{nullptr};
+    const uint8_t* buffer_{nullptr}; ///< Received packet, in the receive DMA buffer
     uint32_t from_ip_{0};
     uint32_t length_{0};
     uint32_t data_length_{0};
     uint32_t packet_length_{0};
+    uint32_t transfer_size_{0};
+    uint32_t block_number_{0};
+    uint32_t sent_millis_{0};
+    uint32_t rto_{1000};
+    uint32_t srtt_{0};
+    uint32_t rttvar_{0};
+    uint32_t retries_{0};
+    uint32_t multicast_ip_{0};
+    TimerHandle_t timer_id_{kTimerIdNone};
+    TimerHandle_t resume_timer_id_{kTimerIdNone}; ///< Running while a window waits for a TX descriptor
     uint16_t from_port_{0};
-    uint16_t block_number_{0};
+    uint16_t multicast_port_{0};
+    uint16_t block_size_{512};
+    uint16_t window_size_{1};
+    uint16_t window_count_{0};
+    uint8_t options_{0};
     bool is_last_block_{false};
+    bool is_out_of_order_acked_{false};
+    bool is_multicast_{false};
+    bool is_master_{true};
 
     static TFTPDaemon* Get() { return s_this; }
 
    private:
     void static StaticCallbackFunction(const uint8_t* buffer, uint32_t size, uint32_t from_ip, uint16_t from_port) { s_this->Input(buffer, size, from_ip, from_port); }
+    void static StaticCallbackFunctionTimer([[maybe_unused]] TimerHandle_t handle) { s_this->Timer(); }
+    void static StaticCallbackFunctionResumeTimer([[maybe_unused]] TimerHandle_t handle) { s_this->ResumeTimer(); }
     static inline TFTPDaemon* s_this;
 };
 
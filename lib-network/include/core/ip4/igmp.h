@@ -31,8 +31,17 @@
 namespace emac::multicast {
 void EnableHashFilter();
 void DisableHashFilter();
+/**
+ * The hash bits are reference counted: SetHash for each group joined,
+ * ClearHash when it leaves.
+ */
 void SetHash(const uint8_t*);
+void ClearHash(const uint8_t*);
 void ResetHash();
+/**
+ * Writes the multicast filter mode and the hash table back after the MAC is (re)initialized
+ */
+void Restore();
 } // namespace emac::multicast
 
 #endif // CORE_IP4_IGMP_H_
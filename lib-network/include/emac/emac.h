@@ -42,6 +42,14 @@ void Config();
 
 void AdjustLink(emac::phy::Status phy_status);
 
+/**
+ * Diagnostic mode: every frame on the segment is received, the MAC address filters are bypassed.
+ * Default is off (CONFIG_EMAC_PROMISCUOUS), the frames are filtered with
+ * perfect unicast, broadcast and hash multicast (see \ref emac::multicast)
+ */
+void SetPromiscuous(bool enable);
+bool IsPromiscuous();
+
 /**
  *
  * - Soft MAC reset
@@ -60,15 +60,23 @@ void Run();
 #endif
 
 inline void Run() {
-    uint8_t* ethernet_buffer;
-    auto length = emac::eth::Recv(&ethernet_buffer);
+    // A zero-copy UDP datagram on hold keeps the current receive descriptor
+    if (__builtin_expect(!network::udp::IsHeld(), 1)) {
+        uint8_t* ethernet_buffer;
+        auto length = emac::eth::Recv(&ethernet_buffer);
 
-    if (__builtin_expect((length > 0), 0)) {
-        do {
-            network::iface::EthernetInput(ethernet_buffer, length);
-            length = emac::eth::Recv(&ethernet_buffer);
-        } while (length > 0);
+        if (__builtin_expect((length > 0), 0)) {
+            do {
+                network::iface::EthernetInput(ethernet_buffer, length);
+                if (network::udp::IsHeld()) {
+                    break;
+                }
+                length = emac::eth::Recv(&ethernet_buffer);
+            } while (length > 0);
+        }
     }
+    // One poll demand for the frames queued, the transmitted descriptors are counted
+    emac::eth::SendReclaim();
 #if defined(ENABLE_HTTPD)
     network::tcp::Run();
 #endif
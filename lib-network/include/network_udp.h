@@ -31,10 +31,32 @@
 namespace network::udp {
 typedef void (*UdpCallbackFunctionPtr)(const uint8_t*, uint32_t, uint32_t, uint16_t);
 
-int32_t Begin(uint16_t, UdpCallbackFunctionPtr callback);
+enum class Mode : uint8_t {
+    kCopy,    ///< The datagram is copied into a port buffer, valid until the next datagram
+    kZeroCopy ///< The callback gets the receive DMA buffer, valid until the callback returns or Release()
+};
+
+namespace global {
+extern uint32_t held_token;
+} // namespace global
+
+int32_t Begin(uint16_t, UdpCallbackFunctionPtr callback, Mode mode = Mode::kCopy);
 int32_t End(uint16_t);
+/**
+ * Zero-copy only, called from the callback: keep the datagram after the callback returns.
+ * Receiving is paused until the returned token is released.
+ * @return token, 0 when not called from a zero-copy callback
+ */
+uint32_t Hold();
+void Release(uint32_t token);
+inline bool IsHeld() {
+    return global::held_token != 0;
+}
 uint32_t Recv(const int32_t, const uint8_t**, uint32_t*, uint16_t*);
-void Send(int32_t, const uint8_t*, uint32_t, uint32_t, uint16_t);
+/**
+ * @return false when no TX descriptor is free, the datagram is not sent
+ */
+bool Send(int32_t, const uint8_t*, uint32_t, uint32_t, uint16_t);
 void SendWithTimestamp(int32_t, const uint8_t*, uint32_t, uint32_t, uint16_t);
 } // namespace network::udp
 
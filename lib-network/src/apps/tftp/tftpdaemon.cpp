@@ -25,15 +25,32 @@
 
 /*
  * https://tools.ietf.org/html/rfc1350
+ * https://tools.ietf.org/html/rfc2347 Option Extension
+ * https://tools.ietf.org/html/rfc2348 Blocksize Option
+ * https://tools.ietf.org/html/rfc2349 Transfer Size Option
+ * https://tools.ietf.org/html/rfc7440 Windowsize Option
+ * https://tools.ietf.org/html/rfc2090 Multicast Option
+ *
+ * The multicast option is used with a WRQ, so that a group of nodes receives
+ * the same DATA stream: "multicast" "<group>,<port>,<1 = master, 0 = other>".
+ * The master client acknowledges as in a unicast transfer. The other clients
+ * stay silent, except for an ACK of their last in-order block (a NAK) on a gap
+ * or a timeout. All clients acknowledge the last block.
  */
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <cassert>
 
 #include "network_udp.h"
+#include "network_igmp.h"
+#include "ip4/ip4_address.h"
+#include "softwaretimers.h"
+#include "timing.h"
 #include "apps/tftpdaemon.h"
 #include "core/protocol/iana.h"
+#include "core/protocol/udp.h"
 #include "firmware/debug/debug_debug.h"
 
 #if defined(DEBUG_NET_APPS_TFTP)
@@ -61,6 +78,7 @@ static constexpr uint16_t kOpCodeWrq = 2;   ///< Write request (WRQ)
 static constexpr uint16_t kOpCodeData = 3;  ///< Data (DATA)
 static constexpr uint16_t kOpCodeAck = 4;   ///< Acknowledgment (ACK)
 static constexpr uint16_t kOpCodeError = 5; ///< Error (ERROR)
+static constexpr uint16_t kOpCodeOack = 6;  ///< Option acknowledgment (OACK)
 
 static constexpr uint16_t kErrorCodeOther = 0;    ///< Not defined, see error message (if any).
 static constexpr uint16_t kErrorCodeNoFile = 1;   ///< File not found.
@@ -72,18 +90,40 @@ static constexpr uint16_t kErrorCodeIllOper = 4;  ///< Illegal TFTP operation.
 // static constexpr uint16_t ERROR_CODE_INV_USER = 7;///< No such user.
 
 namespace tftp {
+static constexpr uint16_t kBlockSize = 512; ///< RFC 1350 data length
+// Retransmission support
+static constexpr uint32_t kTimerIntervalMs = 20;
+static constexpr uint32_t kRtoInitialMs = 1000;
+static constexpr uint32_t kRtoMinMs = 100;
+static constexpr uint32_t kRtoMaxMs = 8000;
+static constexpr uint32_t kMaxRetries = 5;
+
 namespace min {
 static constexpr uint32_t kFilenameModeLen = (1 + 1 + 1 + 1);
-}
+static constexpr uint32_t kBlockSize = 64; ///< The first block holds the vector table and the image info
+} // namespace min
 
 namespace max {
 static constexpr uint32_t kFilenameLen = 128;
 static constexpr uint32_t kModeLen = 16;
 static constexpr uint32_t kFilenameModeLen = (kFilenameLen + 1 + kModeLen + 1);
-static constexpr uint32_t kDataLen = 512;
+static constexpr uint32_t kDataLen = network::udp::kDataSize - 4; ///< Largest blksize without IP fragmentation
 static constexpr uint32_t kErrmsgLen = 128;
+static constexpr uint32_t kOptionsLen = 96;
+static constexpr uint16_t kWindowSize = 32;
 } // namespace max
 
+namespace option {
+static constexpr char kWindowSize[] = "windowsize";
+static constexpr char kBlockSize[] = "blksize";
+static constexpr char kTransferSize[] = "tsize";
+static constexpr char kMulticast[] = "multicast";
+static constexpr uint8_t kFlagWindowSize = (1U << 0);
+static constexpr uint8_t kFlagBlockSize = (1U << 1);
+static constexpr uint8_t kFlagTransferSize = (1U << 2);
+static constexpr uint8_t kFlagMulticast = (1U << 3);
+} // namespace option
+
 #if !defined(PACKED)
 #define PACKED __attribute__((packed))
 #endif
@@ -104,6 +144,11 @@ struct ErrorPacket {
     char err_msg[max::kErrmsgLen];
 } PACKED;
 
+struct OackPacket {
+    uint16_t op_code;
+    char options[max::kOptionsLen];
+} PACKED;
+
 struct DataPacket {
     uint16_t op_code;
     uint16_t block_number;
@@ -111,6 +156,77 @@ struct DataPacket {
 } PACKED;
 } // namespace tftp
 
+/*
+ * The ports are zero-copy: a received packet is valid during Input only.
+ * The outgoing packets are built here, they are rebuilt for a retransmit.
+ */
+static uint8_t s_packet[network::udp::kDataSize] __attribute__((aligned(4)));
+
+static uint32_t ToNumber(const char* value, size_t length) {
+    uint32_t number = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        if ((value[i] < '0') || (value[i] > '9') || (number >= (UINT32_MAX / 10))) {
+            return 0;
+        }
+        number = (number * 10) + static_cast<uint32_t>(value[i] - '0');
+    }
+
+    return number;
+}
+
+static uint32_t AddOption(char* options, const char* name, uint32_t value) {
+    const auto kNameLength = strlen(name) + 1;
+    memcpy(options, name, kNameLength);
+
+    const auto kValueLength = snprintf(&options[kNameLength], 11, "%u", static_cast<unsigned int>(value)) + 1;
+
+    return static_cast<uint32_t>(kNameLength) + static_cast<uint32_t>(kValueLength);
+}
+
+static uint32_t AddOption(char* options, const char* name, const char* value) {
+    const auto kNameLength = strlen(name) + 1;
+    memcpy(options, name, kNameLength);
+
+    const auto kValueLength = strlen(value) + 1;
+    memcpy(&options[kNameLength], value, kValueLength);
+
+    return static_cast<uint32_t>(kNameLength + kValueLength);
+}
+
+/*
+ * "<a.b.c.d>,<port>,<mc>"
+ */
+static bool ParseMulticast(const char* value, size_t length, uint32_t& ip, uint16_t& port, bool& is_master) {
+    uint32_t fields[6] = {0, 0, 0, 0, 0, 0};
+    uint32_t field = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        const auto kChar = value[i];
+
+        if ((kChar >= '0') && (kChar <= '9')) {
+            fields[field] = (fields[field] * 10) + static_cast<uint32_t>(kChar - '0');
+            if (fields[field] > UINT16_MAX) {
+                return false;
+            }
+        } else if (((kChar == '.') && (field < 3)) || ((kChar == ',') && ((field == 3) || (field == 4)))) {
+            field++;
+        } else {
+            return false;
+        }
+    }
+
+    if ((field != 5) || (fields[0] > 255) || (fields[1] > 255) || (fields[2] > 255) || (fields[3] > 255) || (fields[4] == 0) || (fields[5] > 1)) {
+        return false;
+    }
+
+    ip = network::ConvertToUint(static_cast<uint8_t>(fields[0]), static_cast<uint8_t>(fields[1]), static_cast<uint8_t>(fields[2]), static_cast<uint8_t>(fields[3]));
+    port = static_cast<uint16_t>(fields[4]);
+    is_master = (fields[5] == 1);
+
+    return network::IsMulticastIp(ip);
+}
+
 TFTPDaemon::TFTPDaemon() {
     TFTP_DEBUG_ENTRY();
     TFTP_DEBUG_PRINTF("s_this=%p", reinterpret_cast<void*>(s_this));
@@ -123,6 +239,8 @@ TFTPDaemon::TFTPDaemon() {
 
     Init();
 
+    timer_id_ = SoftwareTimerAdd(tftp::kTimerIntervalMs, StaticCallbackFunctionTimer);
+
     TFTP_DEBUG_PRINTF("s_this=%p", reinterpret_cast<void*>(s_this));
     TFTP_DEBUG_EXIT();
 }
@@ -131,7 +249,20 @@ TFTPDaemon::~TFTPDaemon() {
     TFTP_DEBUG_ENTRY();
     TFTP_DEBUG_PRINTF("s_this=%p", reinterpret_cast<void*>(s_this));
 
-    network::udp::End(from_port_);
+    if (timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(timer_id_);
+    }
+
+    if (resume_timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(resume_timer_id_);
+    }
+
+    if (is_multicast_) {
+        network::igmp::LeaveGroup(index_, multicast_ip_);
+        network::udp::End(multicast_port_);
+    } else {
+        network::udp::End(from_port_);
+    }
 
     s_this = nullptr;
 
@@ -142,24 +273,119 @@ void TFTPDaemon::Init() {
     TFTP_DEBUG_ENTRY();
     assert(state_ == State::kInit);
 
-    if (from_port_ != 0) {
+    if (is_multicast_) {
+        network::igmp::LeaveGroup(index_, multicast_ip_);
+        network::udp::End(multicast_port_);
+        index_ = -1;
+    } else if (from_port_ != 0) {
         network::udp::End(from_port_);
         index_ = -1;
     }
 
-    index_ = network::udp::Begin(network::iana::Ports::kPortTftp, TFTPDaemon::StaticCallbackFunction);
+    if (resume_timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(resume_timer_id_);
+    }
+
+    index_ = network::udp::Begin(network::iana::Ports::kPortTftp, TFTPDaemon::StaticCallbackFunction, network::udp::Mode::kZeroCopy);
     TFTP_DEBUG_PRINTF("index_=%d", static_cast<int>(index_));
 
     from_port_ = network::iana::Ports::kPortTftp;
     block_number_ = 0;
+    block_size_ = tftp::kBlockSize;
+    transfer_size_ = 0;
+    window_size_ = 1;
+    window_count_ = 0;
+    options_ = 0;
     state_ = State::kWaitingRq;
     is_last_block_ = false;
+    is_out_of_order_acked_ = false;
+    multicast_ip_ = 0;
+    multicast_port_ = 0;
+    is_multicast_ = false;
+    is_master_ = true;
+    rto_ = tftp::kRtoInitialMs;
+    srtt_ = 0;
+    rttvar_ = 0;
+    retries_ = 0;
 
     TFTP_DEBUG_EXIT();
 }
 
+/*
+ * RFC 6298 style RTO from the smoothed round trip time.
+ * A reply to a retransmitted packet is ambiguous and is not sampled (Karn).
+ */
+void TFTPDaemon::UpdateRto() {
+    if (retries_ != 0) {
+        retries_ = 0;
+        return;
+    }
+
+    const auto kRtt = timing::Millis() - sent_millis_;
+
+    if (srtt_ == 0) {
+        srtt_ = kRtt;
+        rttvar_ = kRtt / 2;
+    } else {
+        const auto kDelta = (srtt_ > kRtt) ? (srtt_ - kRtt) : (kRtt - srtt_);
+        rttvar_ = ((3 * rttvar_) + kDelta) / 4;
+        srtt_ = ((7 * srtt_) + kRtt) / 8;
+    }
+
+    rto_ = srtt_ + ((4 * rttvar_) > tftp::kTimerIntervalMs ? (4 * rttvar_) : tftp::kTimerIntervalMs);
+
+    if (rto_ < tftp::kRtoMinMs) {
+        rto_ = tftp::kRtoMinMs;
+    } else if (rto_ > tftp::kRtoMaxMs) {
+        rto_ = tftp::kRtoMaxMs;
+    }
+
+    TFTP_DEBUG_PRINTF("kRtt=%u, srtt_=%u, rttvar_=%u, rto_=%u", static_cast<unsigned>(kRtt), static_cast<unsigned>(srtt_), static_cast<unsigned>(rttvar_), static_cast<unsigned>(rto_));
+}
+
+void TFTPDaemon::Timer() {
+    if ((state_ != State::kRrqRecvAck) && (state_ != State::kWrqRecvPacket)) {
+        return;
+    }
+
+    if ((timing::Millis() - sent_millis_) < rto_) {
+        return;
+    }
+
+    if (++retries_ > tftp::kMaxRetries) {
+        TFTP_DEBUG_PUTS("Timeout");
+        SendError(kErrorCodeOther, "Timeout");
+        FileAbort();
+        state_ = State::kInit;
+        Init();
+        return;
+    }
+
+    rto_ = (2 * rto_) < tftp::kRtoMaxMs ? (2 * rto_) : tftp::kRtoMaxMs;
+
+    TFTP_DEBUG_PRINTF("Retransmit %u, rto_=%u", static_cast<unsigned>(retries_), static_cast<unsigned>(rto_));
+
+    // The packets are rebuilt from the session state, the file is read again when needed
+    if (state_ == State::kRrqRecvAck) {
+        if ((block_number_ == 0) && (options_ != 0)) {
+            SendOptionAck();
+        } else {
+            block_number_ -= window_count_;
+            DoRead();
+        }
+    } else {
+        window_count_ = 0;
+
+        if ((block_number_ == 0) && (options_ != 0)) {
+            SendOptionAck();
+        } else {
+            DoWriteAck();
+        }
+    }
+}
+
 void TFTPDaemon::Input(const uint8_t* buffer, uint32_t size, uint32_t from_ip, uint16_t from_port) {
-    buffer_ = const_cast<uint8_t*>(buffer);
+    buffer_ = buffer;
     length_ = size;
     from_ip_ = from_ip;
     from_port_ = from_port;
@@ -170,16 +396,13 @@ void TFTPDaemon::Input(const uint8_t* buffer, uint32_t size, uint32_t from_ip, u
                 HandleRequest();
             }
             break;
-        case State::kRrqSendPacket:
-            DoRead();
-            break;
         case State::kRrqRecvAck:
             if (length_ == sizeof(struct tftp::AckPacket)) {
                 HandleRecvAck();
             }
             break;
         case State::kWrqRecvPacket:
-            if (length_ <= sizeof(struct tftp::DataPacket)) {
+            if (length_ <= (sizeof(struct tftp::DataPacket) - sizeof(tftp::DataPacket::data) + block_size_)) {
                 HandleRecvData();
             }
             break;
@@ -191,7 +414,7 @@ void TFTPDaemon::Input(const uint8_t* buffer, uint32_t size, uint32_t from_ip, u
 }
 
 void TFTPDaemon::HandleRequest() {
-    auto* const kPacket = reinterpret_cast<struct tftp::ReqPacket*>(buffer_);
+    const auto* const kPacket = reinterpret_cast<const struct tftp::ReqPacket*>(buffer_);
     assert(kPacket != nullptr);
 
     const auto kOpCode = __builtin_bswap16(kPacket->op_code);
@@ -221,7 +444,9 @@ void TFTPDaemon::HandleRequest() {
         return;
     }
 
-    TFTP_DEBUG_PRINTF("Incoming %s request from " IPSTR " %s %s", kOpCode == kOpCodeRrq ? "read" : "write", IP2STR(from_ip_), kFileName, kMode);
+    HandleOptions(kMode + strlen(kMode) + 1);
+
+    TFTP_DEBUG_PRINTF("Incoming %s request from " IPSTR " %s %s, options_=%x, block_size_=%u, window_size_=%u, transfer_size_=%u", kOpCode == kOpCodeRrq ? "read" : "write", IP2STR(from_ip_), kFileName, kMode, options_, block_size_, window_size_, static_cast<unsigned>(transfer_size_));
 
     switch (kOpCode) {
         case kOpCodeRrq:
@@ -230,20 +455,59 @@ void TFTPDaemon::HandleRequest() {
                 state_ = State::kWaitingRq;
             } else {
                 network::udp::End(network::iana::Ports::kPortTftp);
-                index_ = network::udp::Begin(from_port_, TFTPDaemon::StaticCallbackFunction);
-                state_ = State::kRrqSendPacket;
-                DoRead();
+                index_ = network::udp::Begin(from_port_, TFTPDaemon::StaticCallbackFunction, network::udp::Mode::kZeroCopy);
+                block_number_ = 0;
+                window_count_ = 0;
+                // Multicast is a write option only
+                options_ &= static_cast<uint8_t>(~tftp::option::kFlagMulticast);
+
+                if ((options_ & tftp::option::kFlagTransferSize) != 0) {
+                    // Reply with the file size, leave the option out when the size is not known
+                    transfer_size_ = FileSize();
+
+                    if (transfer_size_ == 0) {
+                        options_ &= static_cast<uint8_t>(~tftp::option::kFlagTransferSize);
+                    }
+                }
+
+                if (options_ != 0) {
+                    // The data transfer starts when the OACK is acknowledged with block 0
+                    SendOptionAck();
+                    state_ = State::kRrqRecvAck;
+                } else {
+                    DoRead();
+                }
             }
             break;
         case kOpCodeWrq:
             if (!FileCreate(kFileName, mode)) {
                 SendError(kErrorCodeAccess, "Access violation");
                 state_ = State::kWaitingRq;
+            } else if (((options_ & tftp::option::kFlagTransferSize) != 0) && !FileReserve(transfer_size_)) {
+                SendError(kErrorCodeDiskFull, "File too large");
+                state_ = State::kWaitingRq;
             } else {
                 network::udp::End(network::iana::Ports::kPortTftp);
-                index_ = network::udp::Begin(from_port_, TFTPDaemon::StaticCallbackFunction);
-                state_ = State::kWrqSendAck;
-                DoWriteAck();
+
+                if ((options_ & tftp::option::kFlagMulticast) != 0) {
+                    index_ = network::udp::Begin(multicast_port_, TFTPDaemon::StaticCallbackFunction, network::udp::Mode::kZeroCopy);
+                    network::igmp::JoinGroup(index_, multicast_ip_);
+                    is_multicast_ = true;
+                } else {
+                    index_ = network::udp::Begin(from_port_, TFTPDaemon::StaticCallbackFunction, network::udp::Mode::kZeroCopy);
+                }
+
+                block_number_ = 0;
+                window_count_ = 0;
+
+                if (options_ != 0) {
+                    // The OACK replaces the ACK of block 0
+                    SendOptionAck();
+                    state_ = State::kWrqRecvPacket;
+                } else {
+                    state_ = State::kWrqSendAck;
+                    DoWriteAck();
+                }
             }
             break;
         default:
@@ -253,6 +517,91 @@ void TFTPDaemon::HandleRequest() {
     }
 }
 
+/*
+ * The options follow the mode as "name\0value\0" pairs.
+ * Unknown options are ignored, the accepted ones are returned in the OACK.
+ */
+void TFTPDaemon::HandleOptions(const char* options) {
+    const auto* const kEnd = reinterpret_cast<const char*>(buffer_) + length_;
+
+    block_size_ = tftp::kBlockSize;
+    transfer_size_ = 0;
+    window_size_ = 1;
+    options_ = 0;
+    multicast_ip_ = 0;
+    multicast_port_ = 0;
+    is_master_ = true;
+
+    while (options < kEnd) {
+        const auto* const kValue = options + strnlen(options, static_cast<size_t>(kEnd - options)) + 1;
+
+        if (kValue >= kEnd) {
+            break;
+        }
+
+        const auto kValueLength = strnlen(kValue, static_cast<size_t>(kEnd - kValue));
+        const auto kNumber = ToNumber(kValue, kValueLength);
+
+        TFTP_DEBUG_PRINTF("%s=%u", options, static_cast<unsigned>(kNumber));
+
+        if (strcasecmp(options, tftp::option::kWindowSize) == 0) {
+            if ((kNumber >= 1) && (kNumber <= UINT16_MAX)) {
+                window_size_ = static_cast<uint16_t>(kNumber < tftp::max::kWindowSize ? kNumber : tftp::max::kWindowSize);
+                options_ |= tftp::option::kFlagWindowSize;
+            }
+        } else if (strcasecmp(options, tftp::option::kBlockSize) == 0) {
+            // A smaller blksize is not accepted, the OACK value must not be larger than the one requested (RFC 2348)
+            if (kNumber >= tftp::min::kBlockSize) {
+                // FileWrite is at (block - 1) * blksize, the blksize is rounded down to a multiple of FileBlockAlign
+                const auto kAlign = FileBlockAlign();
+                assert((kAlign != 0) && ((kAlign & (kAlign - 1)) == 0) && ((tftp::min::kBlockSize % kAlign) == 0));
+                block_size_ = static_cast<uint16_t>((kNumber < tftp::max::kDataLen ? kNumber : tftp::max::kDataLen) & ~(kAlign - 1));
+                options_ |= tftp::option::kFlagBlockSize;
+            }
+        } else if (strcasecmp(options, tftp::option::kTransferSize) == 0) {
+            transfer_size_ = kNumber;
+            options_ |= tftp::option::kFlagTransferSize;
+        } else if (strcasecmp(options, tftp::option::kMulticast) == 0) {
+            if (ParseMulticast(kValue, kValueLength, multicast_ip_, multicast_port_, is_master_)) {
+                options_ |= tftp::option::kFlagMulticast;
+            }
+        }
+
+        options = kValue + kValueLength + 1;
+    }
+}
+
+void TFTPDaemon::SendOptionAck() {
+    auto* const kOackPacket = reinterpret_cast<struct tftp::OackPacket*>(s_packet);
+
+    kOackPacket->op_code = __builtin_bswap16(kOpCodeOack);
+
+    uint32_t length = 0;
+
+    if ((options_ & tftp::option::kFlagWindowSize) != 0) {
+        length += AddOption(&kOackPacket->options[length], tftp::option::kWindowSize, window_size_);
+    }
+
+    if ((options_ & tftp::option::kFlagBlockSize) != 0) {
+        length += AddOption(&kOackPacket->options[length], tftp::option::kBlockSize, block_size_);
+    }
+
+    if ((options_ & tftp::option::kFlagTransferSize) != 0) {
+        length += AddOption(&kOackPacket->options[length], tftp::option::kTransferSize, transfer_size_);
+    }
+
+    if ((options_ & tftp::option::kFlagMulticast) != 0) {
+        char multicast[24];
+        snprintf(multicast, sizeof(multicast), IPSTR ",%u,%u", IP2STR(multicast_ip_), static_cast<unsigned int>(multicast_port_), is_master_ ? 1U : 0U);
+        length += AddOption(&kOackPacket->options[length], tftp::option::kMulticast, multicast);
+    }
+
+    TFTP_DEBUG_PRINTF("Sending OACK to " IPSTR ":%u, length=%u", IP2STR(from_ip_), static_cast<unsigned>(from_port_), static_cast<unsigned>(length));
+
+    network::udp::Send(index_, s_packet, sizeof kOackPacket->op_code + length, from_ip_, from_port_);
+    sent_millis_ = timing::Millis();
+}
+
 void TFTPDaemon::SendError(uint16_t error_code, const char* error_message) {
     tftp::ErrorPacket error_packet;
 
@@ -263,57 +612,113 @@ void TFTPDaemon::SendError(uint16_t error_code, const char* error_message) {
     network::udp::Send(index_, reinterpret_cast<const uint8_t*>(&error_packet), sizeof error_packet, from_ip_, from_port_);
 }
 
+/*
+ * Send a window of DATA blocks, following the last acknowledged block_number_.
+ * A block is read again from the file when the window has to be resent.
+ */
 void TFTPDaemon::DoRead() {
-    auto* const kDataPacket = reinterpret_cast<struct tftp::DataPacket*>(buffer_);
-    assert(kDataPacket != nullptr);
+    sent_millis_ = timing::Millis();
+    window_count_ = 0;
+    is_last_block_ = false;
+    state_ = State::kRrqRecvAck;
 
-    if (state_ == State::kRrqSendPacket) {
-        data_length_ = FileRead(kDataPacket->data, tftp::max::kDataLen, ++block_number_);
+    SendWindow();
+}
+
+/*
+ * The window is larger than the TX ring: a block that finds no free descriptor is not sent,
+ * the window stops there and the resume timer sends the rest when the DMA has caught up.
+ */
+void TFTPDaemon::SendWindow() {
+    auto* const kDataPacket = reinterpret_cast<struct tftp::DataPacket*>(s_packet);
+
+    while ((window_count_ < window_size_) && !is_last_block_) {
+        data_length_ = FileRead(kDataPacket->data, block_size_, ++block_number_);
 
         kDataPacket->op_code = __builtin_bswap16(kOpCodeData);
-        kDataPacket->block_number = __builtin_bswap16(block_number_);
+        kDataPacket->block_number = __builtin_bswap16(static_cast<uint16_t>(block_number_));
 
         packet_length_ = sizeof kDataPacket->op_code + sizeof kDataPacket->block_number + data_length_;
-        is_last_block_ = data_length_ < tftp::max::kDataLen;
 
-        if (is_last_block_) {
-            FileClose();
+        TFTP_DEBUG_PRINTF("Sending to " IPSTR ":%d, block_number_=%u, data_length_=%u", IP2STR(from_ip_), from_port_, static_cast<unsigned>(block_number_), static_cast<unsigned>(data_length_));
+
+        if (!network::udp::Send(index_, s_packet, packet_length_, from_ip_, from_port_)) {
+            block_number_--;
+
+            if (resume_timer_id_ == kTimerIdNone) {
+                resume_timer_id_ = SoftwareTimerAdd(1, StaticCallbackFunctionResumeTimer);
+            }
+            return;
         }
 
-        TFTP_DEBUG_PRINTF("data_length_=%u, packet_length_=%u, is_last_block_=%u", static_cast<unsigned>(data_length_), static_cast<unsigned>(packet_length_), static_cast<unsigned>(is_last_block_));
+        window_count_++;
+        is_last_block_ = data_length_ < block_size_;
     }
 
-    TFTP_DEBUG_PRINTF("Sending to " IPSTR ":%d", IP2STR(from_ip_), from_port_);
+    if (resume_timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(resume_timer_id_);
+    }
+}
 
-    network::udp::Send(index_, buffer_, packet_length_, from_ip_, from_port_);
+void TFTPDaemon::ResumeTimer() {
+    if (state_ == State::kRrqRecvAck) {
+        SendWindow();
+        return;
+    }
 
-    state_ = State::kRrqRecvAck;
+    SoftwareTimerDelete(resume_timer_id_);
 }
 
 void TFTPDaemon::HandleRecvAck() {
-    const auto* const kAckPacket = reinterpret_cast<struct tftp::AckPacket*>(buffer_);
+    const auto* const kAckPacket = reinterpret_cast<const struct tftp::AckPacket*>(buffer_);
     assert(kAckPacket != nullptr);
 
-    if (kAckPacket->op_code == __builtin_bswap16(kOpCodeAck)) {
-        TFTP_DEBUG_PRINTF("Incoming from " IPSTR ", block_number=%d, block_number_=%d", IP2STR(from_ip_), __builtin_bswap16(kAckPacket->block_number), block_number_);
+    if (kAckPacket->op_code != __builtin_bswap16(kOpCodeAck)) {
+        return;
+    }
+
+    const auto kBlockNumber = __builtin_bswap16(kAckPacket->block_number);
+    // Number of blocks acknowledged from the window in flight
+    const auto kAcked = static_cast<uint16_t>(kBlockNumber - static_cast<uint16_t>(block_number_ - window_count_));
 
-        if (kAckPacket->block_number == __builtin_bswap16(block_number_)) {
-            state_ = is_last_block_ ? State::kInit : State::kRrqSendPacket;
-        }
+    TFTP_DEBUG_PRINTF("Incoming from " IPSTR ", block_number=%u, block_number_=%u, kAcked=%u", IP2STR(from_ip_), kBlockNumber, static_cast<unsigned>(block_number_), kAcked);
+
+    if (kAcked > window_count_) {
+        return;
     }
+
+    // In lock-step mode an ACK of the previous block is a duplicate, else the receiver asks to resend the window
+    if ((kAcked == 0) && (window_size_ == 1) && (window_count_ != 0)) {
+        return;
+    }
+
+    if (kAcked != 0) {
+        UpdateRto();
+    }
+
+    if ((kAcked == window_count_) && is_last_block_) {
+        FileClose();
+        state_ = State::kInit;
+        Init();
+        return;
+    }
+
+    // The block number on the wire is 16-bit, block_number_ keeps counting past 65535
+    block_number_ = block_number_ - window_count_ + kAcked;
+    DoRead();
 }
 
 void TFTPDaemon::DoWriteAck() {
-    auto* const kAckPacket = reinterpret_cast<struct tftp::AckPacket*>(buffer_);
-    assert(kAckPacket != nullptr);
+    auto* const kAckPacket = reinterpret_cast<struct tftp::AckPacket*>(s_packet);
 
     kAckPacket->op_code = __builtin_bswap16(kOpCodeAck);
-    kAckPacket->block_number = __builtin_bswap16(block_number_);
+    kAckPacket->block_number = __builtin_bswap16(static_cast<uint16_t>(block_number_));
     state_ = is_last_block_ ? State::kInit : State::kWrqRecvPacket;
 
     TFTP_DEBUG_PRINTF("Sending to " IPSTR ":%u, state_=%d", IP2STR(from_ip_), static_cast<unsigned>(from_port_), static_cast<int>(state_));
 
-    network::udp::Send(index_, buffer_, sizeof(struct tftp::AckPacket), from_ip_, from_port_);
+    network::udp::Send(index_, s_packet, sizeof(struct tftp::AckPacket), from_ip_, from_port_);
+    sent_millis_ = timing::Millis();
 
     if (state_ == State::kInit) {
         Init();
@@ -321,26 +726,78 @@ void TFTPDaemon::DoWriteAck() {
 }
 
 void TFTPDaemon::HandleRecvData() {
-    const auto* const kDataPacket = reinterpret_cast<struct tftp::DataPacket*>(buffer_);
+    const auto* const kDataPacket = reinterpret_cast<const struct tftp::DataPacket*>(buffer_);
     assert(kDataPacket != nullptr);
 
-    if (kDataPacket->op_code == __builtin_bswap16(kOpCodeData)) {
-        data_length_ = length_ - 4;
-        block_number_ = __builtin_bswap16(kDataPacket->block_number);
+    constexpr uint32_t kHeaderSize = sizeof kDataPacket->op_code + sizeof kDataPacket->block_number;
 
-        TFTP_DEBUG_PRINTF("Incoming from " IPSTR ", length_=%u, block_number_=%u, data_length_=%u", IP2STR(from_ip_), static_cast<unsigned>(length_), static_cast<unsigned>(block_number_), static_cast<unsigned>(data_length_));
+    // Shorter than the header, data_length_ would underflow
+    if ((length_ < kHeaderSize) || (kDataPacket->op_code != __builtin_bswap16(kOpCodeData))) {
+        return;
+    }
 
-        if (data_length_ == FileWrite(kDataPacket->data, data_length_, block_number_)) {
-            if (data_length_ < tftp::max::kDataLen) {
-                is_last_block_ = true;
-                FileClose();
+    data_length_ = length_ - kHeaderSize;
+    const auto kBlockNumber = __builtin_bswap16(kDataPacket->block_number);
+
+    TFTP_DEBUG_PRINTF("Incoming from " IPSTR ", length_=%u, block_number=%u, block_number_=%u, data_length_=%u", IP2STR(from_ip_), static_cast<unsigned>(length_), kBlockNumber, static_cast<unsigned>(block_number_), static_cast<unsigned>(data_length_));
+
+    if (kBlockNumber != static_cast<uint16_t>(block_number_ + 1)) {
+        /*
+         * The sender resent the last acknowledged block: our ACK got lost, acknowledge again.
+         * A block ahead means a gap: acknowledge the last in-order block once,
+         * so the sender restarts its window from there. Older duplicates are dropped.
+         */
+        if (kBlockNumber == static_cast<uint16_t>(block_number_)) {
+            // In a multicast transfer a resent block is for another client, only the master acknowledges
+            if (is_master_) {
+                window_count_ = 0;
+                DoWriteAck();
             }
+        } else if ((static_cast<uint16_t>(kBlockNumber - static_cast<uint16_t>(block_number_)) < 0x8000) && !is_out_of_order_acked_) {
+            is_out_of_order_acked_ = true;
+            window_count_ = 0;
+            DoWriteAck();
+        }
+        return;
+    }
+
+    is_out_of_order_acked_ = false;
+
+    if (is_master_) {
+        // The first block after our ACK gives the round trip time
+        if (window_count_ == 0) {
+            UpdateRto();
+        }
+    } else {
+        retries_ = 0;
+    }
 
+    // The sender is making progress, the timeout runs from the last in-order block received
+    sent_millis_ = timing::Millis();
+
+    // Block numbers roll over from 65535 to 0, the file offset keeps counting
+    if (data_length_ != FileWrite(kDataPacket->data, data_length_, block_number_ + 1)) {
+        SendError(kErrorCodeDiskFull, "Write failed");
+        state_ = State::kInit;
+        Init();
+        return;
+    }
+
+    block_number_++;
+
+    if (data_length_ < block_size_) {
+        is_last_block_ = true;
+        FileClose();
+        DoWriteAck();
+        return;
+    }
+
+    // Only the last block of a window is acknowledged, by the master. A client counts the window too.
+    if (++window_count_ >= window_size_) {
+        window_count_ = 0;
+
+        if (is_master_) {
             DoWriteAck();
-        } else {
-            SendError(kErrorCodeDiskFull, "Write failed");
-            state_ = State::kInit;
-            Init();
         }
     }
 }
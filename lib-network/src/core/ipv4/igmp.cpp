@@ -81,6 +81,11 @@ struct GroupInfo {
     State state;
 };
 
+#if defined(CONFIG_EMAC_HASH_MULTICAST_FILTER)
+// 224.0.0.1, the general queries, see LookupGroup
+static constexpr uint8_t kAllSystemsMac[6] = {0x01, 0x00, 0x5E, 0x00, 0x00, 0x01};
+#endif
+
 union pcast32 {
     uint32_t u32;
     uint8_t u8[4];
@@ -89,10 +94,79 @@ union pcast32 {
 static struct Header s_report SECTION_NETWORK ALIGNED;
 static struct Header s_leave SECTION_NETWORK ALIGNED;
 static uint8_t s_multicast_mac[network::ethernet::kAddressLength] SECTION_NETWORK ALIGNED;
+/*
+ * Group lookup: open addressing with linear probing, a slot holds the s_groups index + 1, 0 is empty.
+ * The table is at most half full, a group not joined is rejected at the first empty slot.
+ */
+static constexpr uint32_t HashBits() {
+    uint32_t bits = 1;
+    while ((1U << bits) < (2U * IGMP_MAX_JOINS_ALLOWED)) {
+        bits++;
+    }
+    return bits;
+}
+
+static constexpr uint32_t kHashBits = HashBits();
+static constexpr uint32_t kHashMask = (1U << kHashBits) - 1;
+static_assert(IGMP_MAX_JOINS_ALLOWED < UINT8_MAX);
+
 static struct GroupInfo s_groups[IGMP_MAX_JOINS_ALLOWED] SECTION_NETWORK ALIGNED;
+static uint8_t s_group_hash[1U << kHashBits] SECTION_NETWORK ALIGNED;
 static uint16_t s_id SECTION_NETWORK ALIGNED;
 static TimerHandle_t s_timer_id;
 
+// Fibonacci hashing, the top bits of the 32-bit product
+static inline uint32_t Hash(uint32_t group_address) {
+    return (group_address * 2654435769U) >> (32 - kHashBits);
+}
+
+static inline int32_t Lookup(uint32_t group_address) {
+    for (auto slot = Hash(group_address);; slot = (slot + 1) & kHashMask) {
+        const auto kEntry = s_group_hash[slot];
+
+        if (kEntry == 0) {
+            return -1;
+        }
+
+        if (s_groups[kEntry - 1].group_address == group_address) {
+            return kEntry - 1;
+        }
+    }
+}
+
+static void HashInsert(int32_t index) {
+    auto slot = Hash(s_groups[index].group_address);
+
+    while (s_group_hash[slot] != 0) {
+        slot = (slot + 1) & kHashMask;
+    }
+
+    s_group_hash[slot] = static_cast<uint8_t>(index + 1);
+}
+
+/*
+ * Backward shift deletion, as in udp.cpp
+ */
+static void HashRemove(int32_t index) {
+    auto hole = Hash(s_groups[index].group_address);
+
+    while (s_group_hash[hole] != (index + 1)) {
+        hole = (hole + 1) & kHashMask;
+    }
+
+    s_group_hash[hole] = 0;
+
+    for (auto slot = (hole + 1) & kHashMask; s_group_hash[slot] != 0; slot = (slot + 1) & kHashMask) {
+        const auto kHome = Hash(s_groups[s_group_hash[slot] - 1].group_address);
+
+        if (((slot - kHome) & kHashMask) >= ((slot - hole) & kHashMask)) {
+            s_group_hash[hole] = s_group_hash[slot];
+            s_group_hash[slot] = 0;
+            hole = slot;
+        }
+    }
+}
+
 static void SendReport(uint32_t group_address) {
     IGMP_DEBUG_ENTRY();
     pcast32 multicast_ip;
@@ -207,6 +281,7 @@ void __attribute__((cold)) Init() {
 
 #if defined(CONFIG_EMAC_HASH_MULTICAST_FILTER)
     emac::multicast::EnableHashFilter();
+    emac::multicast::SetHash(kAllSystemsMac);
 #endif
 }
 
@@ -255,6 +330,17 @@ static void SendLeave(uint32_t group_address) {
     IGMP_DEBUG_EXIT();
 }
 
+static void QueryReceived(struct GroupInfo& group, uint8_t max_resp_time) {
+    if (group.state == kDelayingMember) {
+        if (max_resp_time < group.timer) {
+            group.timer = static_cast<uint16_t>(1 + max_resp_time / 2);
+        }
+    } else { // group.state == kIdleMember
+        group.state = kDelayingMember;
+        group.timer = static_cast<uint16_t>(1 + max_resp_time / 2);
+    }
+}
+
 __attribute__((hot)) void Input(const struct Header* p_igmp) {
     IGMP_DEBUG_ENTRY();
 
@@ -270,23 +356,17 @@ __attribute__((hot)) void Input(const struct Header* p_igmp) {
             is_general_request = true;
         }
 
-        for (auto& group : s_groups) {
-            if (group.group_address == 0) {
-                continue;
+        if (is_general_request) {
+            for (auto& group : s_groups) {
+                if (group.group_address != 0) {
+                    QueryReceived(group, p_igmp->igmp.igmp.max_resp_time);
+                }
             }
+        } else {
+            const auto kIndex = Lookup(network::MemcpyIp(p_igmp->ip4.dst));
 
-            pcast32 group_address;
-            group_address.u32 = group.group_address;
-
-            if (is_general_request || (memcmp(p_igmp->ip4.dst, group_address.u8, network::ip4::kAddressLength) == 0)) {
-                if (group.state == kDelayingMember) {
-                    if (p_igmp->igmp.igmp.max_resp_time < group.timer) {
-                        group.timer = (1 + p_igmp->igmp.igmp.max_resp_time / 2);
-                    }
-                } else { // s_groups[s_joins_allowed_index].state == IDLE_MEMBER
-                    group.state = kDelayingMember;
-                    group.timer = (1 + p_igmp->igmp.igmp.max_resp_time / 2);
-                }
+            if (kIndex >= 0) {
+                QueryReceived(s_groups[kIndex], p_igmp->igmp.igmp.max_resp_time);
             }
         }
     }
@@ -302,18 +382,16 @@ static void DelayingMember(struct GroupInfo& group, uint32_t maxresp) {
 }
 
 #if defined(CONFIG_EMAC_HASH_MULTICAST_FILTER)
-static void ResetHash() {
-    emac::multicast::ResetHash();
-
-    for (auto& group : s_groups) {
-        if (group.group_address != 0) {
-            pcast32 multicast_ip;
-            multicast_ip.u32 = group.group_address;
-            const uint8_t kMacAddr[6] = {0x01, 0x00, 0x5E, static_cast<uint8_t>(multicast_ip.u8[1] & 0x7F), multicast_ip.u8[2], multicast_ip.u8[3]};
+static void MulticastMac(uint32_t group_address, uint8_t mac_address[6]) {
+    pcast32 multicast_ip;
+    multicast_ip.u32 = group_address;
 
-            emac::multicast::SetHash(kMacAddr);
-        }
-    }
+    mac_address[0] = 0x01;
+    mac_address[1] = 0x00;
+    mac_address[2] = 0x5E;
+    mac_address[3] = static_cast<uint8_t>(multicast_ip.u8[1] & 0x7F);
+    mac_address[4] = multicast_ip.u8[2];
+    mac_address[5] = multicast_ip.u8[3];
 }
 #endif
 
@@ -326,23 +404,24 @@ void static Join(uint32_t group_address) {
         return;
     }
 
-    for (int i = 0; i < IGMP_MAX_JOINS_ALLOWED; i++) {
-        if (s_groups[i].group_address == group_address) {
-            IGMP_DEBUG_EXIT();
-            return;
-        }
+    if (Lookup(group_address) >= 0) {
+        IGMP_DEBUG_EXIT();
+        return;
+    }
 
+    for (int32_t i = 0; i < IGMP_MAX_JOINS_ALLOWED; i++) {
         if (s_groups[i].group_address == 0) {
             s_groups[i].group_address = group_address;
             s_groups[i].state = kDelayingMember;
             s_groups[i].timer = 2; // TODO(avv):
 
+            HashInsert(i);
+
 #if defined(CONFIG_EMAC_HASH_MULTICAST_FILTER)
-            pcast32 multicast_ip;
-            multicast_ip.u32 = group_address;
-            const uint8_t kMacAddr[6] = {0x01, 0x00, 0x5E, static_cast<uint8_t>(multicast_ip.u8[1] & 0x7F), multicast_ip.u8[2], multicast_ip.u8[3]};
-            IGMP_DEBUG_PRINTF(MACSTR, MAC2STR(kMacAddr));
-            emac::multicast::SetHash(kMacAddr);
+            uint8_t mac_address[6];
+            MulticastMac(group_address, mac_address);
+            IGMP_DEBUG_PRINTF(MACSTR, MAC2STR(mac_address));
+            emac::multicast::SetHash(mac_address);
 #endif
             SendReport(group_address);
 
@@ -359,23 +438,30 @@ static void Leave(uint32_t group_address) {
     IGMP_DEBUG_ENTRY();
     IGMP_DEBUG_PRINTF(IPSTR, IP2STR(group_address));
 
-    for (auto& group : s_groups) {
-        if (group.group_address == group_address) {
-            SendLeave(group.group_address);
+    const auto kIndex = Lookup(group_address);
+
+    if (kIndex < 0) {
+        ERROR("Group address not found.\n");
+        IGMP_DEBUG_EXIT();
+        return;
+    }
+
+    auto& group = s_groups[kIndex];
+
+    SendLeave(group.group_address);
+
+    HashRemove(kIndex);
 
-            group.group_address = 0;
-            group.state = kNonMember;
-            group.timer = 0;
+    group.group_address = 0;
+    group.state = kNonMember;
+    group.timer = 0;
 
 #if defined(CONFIG_EMAC_HASH_MULTICAST_FILTER)
-            ResetHash();
+    // Only the hash bit of this group, when no other group shares it
+    uint8_t mac_address[6];
+    MulticastMac(group_address, mac_address);
+    emac::multicast::ClearHash(mac_address);
 #endif
-            IGMP_DEBUG_EXIT();
-            return;
-        }
-    }
-
-	ERROR("Group address not found.\n");
     IGMP_DEBUG_EXIT();
 }
 
@@ -393,11 +479,9 @@ bool LookupGroup(uint32_t group_address) {
     IGMP_DEBUG_ENTRY();
     IGMP_DEBUG_PRINTF(IPSTR, IP2STR(group_address));
 
-    for (auto& group : s_groups) {
-        if (group.group_address == group_address) {
-            IGMP_DEBUG_EXIT();
-            return true;
-        }
+    if (Lookup(group_address) >= 0) {
+        IGMP_DEBUG_EXIT();
+        return true;
     }
 
     IGMP_DEBUG_EXIT();
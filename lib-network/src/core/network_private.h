@@ -41,7 +41,16 @@
 #endif
 
 namespace emac::eth {
-uint8_t* SendGetDmaBuffer();
+/*
+ * TX ring: SendReserve returns nullptr when no descriptor is free, it does not wait.
+ * Frames committed are transmitted after SendFlush, one DMA poll demand.
+ * network::Run() flushes and reclaims the descriptors transmitted.
+ * Send(void*, uint32_t) waits for a free descriptor, an ARP or ICMP frame is not dropped.
+ */
+uint8_t* SendReserve();
+void SendCommit(uint32_t);
+void SendFlush();
+void SendReclaim();
 void Send(uint32_t);
 void Send(void*, uint32_t);
 #if defined CONFIG_NET_ENABLE_PTP
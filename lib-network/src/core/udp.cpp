@@ -65,11 +65,6 @@
 #endif
 
 namespace network::udp {
-struct PortInfo {
-    UdpCallbackFunctionPtr callback;
-    uint16_t port;
-};
-
 struct Data {
     uint32_t from_ip;
     uint32_t size;
@@ -77,15 +72,94 @@ struct Data {
     uint16_t from_port;
 };
 
-struct Port {
-    PortInfo info;
-    Data data ALIGNED;
-} ALIGNED;
+struct PortInfo {
+    UdpCallbackFunctionPtr callback;
+    Data* data; // nullptr: Mode::kZeroCopy
+    uint16_t port;
+};
+
+namespace global {
+uint32_t held_token;
+} // namespace global
 
-static Port s_ports[UDP_MAX_PORTS_ALLOWED] SECTION_NETWORK ALIGNED;
+/*
+ * Port lookup: open addressing with linear probing, a slot holds the s_ports index + 1, 0 is empty.
+ * The table is at most half full, an unbound port is rejected at the first empty slot.
+ */
+static constexpr uint32_t HashBits() {
+    uint32_t bits = 1;
+    while ((1U << bits) < (2U * UDP_MAX_PORTS_ALLOWED)) {
+        bits++;
+    }
+    return bits;
+}
+
+static constexpr uint32_t kHashBits = HashBits();
+static constexpr uint32_t kHashMask = (1U << kHashBits) - 1;
+static_assert(kHashBits <= 16);
+static_assert(UDP_MAX_PORTS_ALLOWED < UINT8_MAX);
+
+static PortInfo s_ports[UDP_MAX_PORTS_ALLOWED] SECTION_NETWORK ALIGNED;
+static uint8_t s_port_hash[1U << kHashBits] SECTION_NETWORK ALIGNED;
+static Data s_data[UDP_MAX_COPY_PORTS] SECTION_NETWORK ALIGNED;
 static uint16_t s_id SECTION_NETWORK ALIGNED;
+static uint32_t s_token SECTION_NETWORK;
+static bool s_is_zero_copy_callback SECTION_NETWORK;
 static uint8_t s_multicast_mac[network::ethernet::kAddressLength] SECTION_NETWORK ALIGNED;
 
+// Fibonacci hashing, the top bits of the 16-bit product
+static inline uint32_t Hash(uint16_t port) {
+    return static_cast<uint16_t>(port * 40503U) >> (16 - kHashBits);
+}
+
+static inline int32_t Lookup(uint16_t port) {
+    for (auto slot = Hash(port);; slot = (slot + 1) & kHashMask) {
+        const auto kEntry = s_port_hash[slot];
+
+        if (kEntry == 0) {
+            return -1;
+        }
+
+        if (s_ports[kEntry - 1].port == port) {
+            return kEntry - 1;
+        }
+    }
+}
+
+static void HashInsert(int32_t index) {
+    auto slot = Hash(s_ports[index].port);
+
+    while (s_port_hash[slot] != 0) {
+        slot = (slot + 1) & kHashMask;
+    }
+
+    s_port_hash[slot] = static_cast<uint8_t>(index + 1);
+}
+
+/*
+ * Backward shift deletion, no tombstones: an entry after the hole
+ * moves into it, unless its home slot is cyclically in (hole, entry].
+ */
+static void HashRemove(int32_t index) {
+    auto hole = Hash(s_ports[index].port);
+
+    while (s_port_hash[hole] != (index + 1)) {
+        hole = (hole + 1) & kHashMask;
+    }
+
+    s_port_hash[hole] = 0;
+
+    for (auto slot = (hole + 1) & kHashMask; s_port_hash[slot] != 0; slot = (slot + 1) & kHashMask) {
+        const auto kHome = Hash(s_ports[s_port_hash[slot] - 1].port);
+
+        if (((slot - kHome) & kHashMask) >= ((slot - hole) & kHashMask)) {
+            s_port_hash[hole] = s_port_hash[slot];
+            s_port_hash[slot] = 0;
+            hole = slot;
+        }
+    }
+}
+
 void __attribute__((cold)) Init() {
     // Multicast fixed part
     s_multicast_mac[0] = network::ethernet::kIP4MulticastAddr0;
@@ -101,46 +175,90 @@ void __attribute__((cold)) Shutdown() {
 
 __attribute__((hot)) void Input(const struct Header* udp) {
     const auto kDestinationPort = __builtin_bswap16(udp->udp.destination_port);
+    const auto kIndex = Lookup(kDestinationPort);
 
-    for (uint32_t port_index = 0; port_index < UDP_MAX_PORTS_ALLOWED; port_index++) {
-        const auto& info = s_ports[port_index].info;
-
-        if (info.port == kDestinationPort) {
-            auto& data = s_ports[port_index].data;
+    // Not bound: dropped before any copy
+    if (__builtin_expect((kIndex < 0), 0)) {
+        emac::eth::FreePkt();
 
-            if (__builtin_expect((data.size != 0), 0)) {
-                UDP_DEBUG_PRINTF("%d[%x]", kDestinationPort, kDestinationPort);
-            }
+        UDP_DEBUG_PRINTF(IPSTR ":%d[%x] " MACSTR, udp->ip4.src[0], udp->ip4.src[1], udp->ip4.src[2], udp->ip4.src[3], kDestinationPort, kDestinationPort, MAC2STR(udp->ether.dst));
+        return;
+    }
 
-            const auto kDataLength = __builtin_bswap16(udp->udp.len) - kHeaderSize;
-            const auto kSize = std::min(kDataSize, kDataLength);
+    const auto& info = s_ports[kIndex];
+    const auto kDataLength = __builtin_bswap16(udp->udp.len) - kHeaderSize;
+    const auto kSize = std::min(kDataSize, kDataLength);
 
-            std::memcpy(data.data, udp->udp.data, kSize);
-            data.from_ip = network::MemcpyIp(udp->ip4.src);
-            data.from_port = __builtin_bswap16(udp->udp.source_port);
-            data.size = kSize;
+    if (info.data == nullptr) {
+        // Zero-copy: the descriptor is released after the callback, unless it is on hold
+        if (info.callback != nullptr) {
+            s_is_zero_copy_callback = true;
+            info.callback(udp->udp.data, kSize, network::MemcpyIp(udp->ip4.src), __builtin_bswap16(udp->udp.source_port));
+            s_is_zero_copy_callback = false;
+        }
 
+        if (global::held_token == 0) {
             emac::eth::FreePkt();
+        }
 
-            if (info.callback != nullptr) {
-                info.callback(data.data, kSize, data.from_ip, data.from_port);
-            }
+        return;
+    }
 
-            return;
-        }
+    auto& data = *info.data;
+
+    if (__builtin_expect((data.size != 0), 0)) {
+        UDP_DEBUG_PRINTF("%d[%x]", kDestinationPort, kDestinationPort);
     }
 
+    std::memcpy(data.data, udp->udp.data, kSize);
+    data.from_ip = network::MemcpyIp(udp->ip4.src);
+    data.from_port = __builtin_bswap16(udp->udp.source_port);
+    data.size = kSize;
+
     emac::eth::FreePkt();
 
-    UDP_DEBUG_PRINTF(IPSTR ":%d[%x] " MACSTR, udp->ip4.src[0], udp->ip4.src[1], udp->ip4.src[2], udp->ip4.src[3], kDestinationPort, kDestinationPort, MAC2STR(udp->ether.dst));
+    if (info.callback != nullptr) {
+        info.callback(data.data, kSize, data.from_ip, data.from_port);
+    }
+}
+
+uint32_t Hold() {
+    if (!s_is_zero_copy_callback || (global::held_token != 0)) {
+        return 0;
+    }
+
+    if (++s_token == 0) {
+        s_token = 1;
+    }
+
+    global::held_token = s_token;
+    return s_token;
 }
 
-template <network::arp::EthSend S> static void SendImplementation(int index, const uint8_t* data, uint32_t size, uint32_t remote_ip, uint16_t remote_port) {
+void Release(uint32_t token) {
+    if ((token == 0) || (token != global::held_token)) {
+        return;
+    }
+
+    global::held_token = 0;
+
+    // Called from the callback: Input frees it on return
+    if (!s_is_zero_copy_callback) {
+        emac::eth::FreePkt();
+    }
+}
+
+template <network::arp::EthSend S> static bool SendImplementation(int index, const uint8_t* data, uint32_t size, uint32_t remote_ip, uint16_t remote_port) {
     assert(index >= 0);
     assert(index < UDP_MAX_PORTS_ALLOWED);
-    assert(s_ports[index].info.port != 0);
+    assert(s_ports[index].port != 0);
 
-    auto* out_buffer = reinterpret_cast<Header*>(emac::eth::SendGetDmaBuffer());
+    auto* out_buffer = reinterpret_cast<Header*>(emac::eth::SendReserve());
+
+    // No free descriptor: the datagram is not sent (tx.drp), the superloop does not wait
+    if (out_buffer == nullptr) {
+        return false;
+    }
 
     // Ethernet
     std::memcpy(out_buffer->ether.src, netif::global::netif_default.hwaddr, network::ethernet::kAddressLength);
@@ -158,7 +276,7 @@ template <network::arp::EthSend S> static void SendImplementation(int index, con
     network::MemcpyIp(out_buffer->ip4.src, netif::global::netif_default.ip.addr);
 
     // UDP
-    out_buffer->udp.source_port = __builtin_bswap16(s_ports[index].info.port);
+    out_buffer->udp.source_port = __builtin_bswap16(s_ports[index].port);
     out_buffer->udp.destination_port = __builtin_bswap16(remote_port);
     out_buffer->udp.len = __builtin_bswap16(static_cast<uint16_t>(size + kHeaderSize));
     out_buffer->udp.checksum = 0;
@@ -197,7 +315,7 @@ template <network::arp::EthSend S> static void SendImplementation(int index, con
                 network::arp::SendTimestamp(out_buffer, size + kUdpPacketHeadersSize, remote_ip);
             }
 #endif
-            return;
+            return true;
         }
     }
 
@@ -205,30 +323,70 @@ template <network::arp::EthSend S> static void SendImplementation(int index, con
     out_buffer->ip4.chksum = network::Chksum(reinterpret_cast<void*>(&out_buffer->ip4), sizeof(out_buffer->ip4));
 #endif
 
+    // The poll demand is issued by network::Run(), a burst of datagrams is one
     if constexpr (S == network::arp::EthSend::kIsNormal) {
-        emac::eth::Send(size + kUdpPacketHeadersSize);
+        emac::eth::SendCommit(size + kUdpPacketHeadersSize);
     }
 #if defined CONFIG_NET_ENABLE_PTP
     else if constexpr (S == network::arp::EthSend::kIsTimestamp) {
         emac::eth::SendTimestamp(size);
     }
 #endif
+
+    return true;
 }
 
-int32_t Begin(uint16_t localport, UdpCallbackFunctionPtr callback) {
-    UDP_DEBUG_PRINTF("localport=%u", static_cast<unsigned>(localport));
+static Data* AllocateData() {
+    for (auto& data : s_data) {
+        bool is_used = false;
 
-    for (auto i = 0; i < UDP_MAX_PORTS_ALLOWED; i++) {
-        auto& info = s_ports[i].info;
+        for (const auto& info : s_ports) {
+            if (info.data == &data) {
+                is_used = true;
+                break;
+            }
+        }
 
-        if (info.port == localport) {
-            return i;
+        if (!is_used) {
+            data.size = 0;
+            return &data;
         }
+    }
+
+    return nullptr;
+}
+
+int32_t Begin(uint16_t localport, UdpCallbackFunctionPtr callback, Mode mode) {
+    UDP_DEBUG_PRINTF("localport=%u, mode=%u", static_cast<unsigned>(localport), static_cast<unsigned>(mode));
+    assert((mode == Mode::kCopy) || (callback != nullptr));
+
+    const auto kIndex = Lookup(localport);
+
+    if (kIndex >= 0) {
+        return kIndex;
+    }
+
+    for (auto i = 0; i < UDP_MAX_PORTS_ALLOWED; i++) {
+        auto& info = s_ports[i];
 
         if (info.port == 0) {
+            Data* data = nullptr;
+
+            if (mode == Mode::kCopy) {
+                data = AllocateData();
+
+                if (data == nullptr) {
+                    ERROR("Max copy ports reached.\n");
+                    return -1;
+                }
+            }
+
             info.callback = callback;
+            info.data = data;
             info.port = localport;
 
+            HashInsert(i);
+
             UDP_DEBUG_PRINTF("i=%d, localport=%d[%x], callback=%p", static_cast<int>(i), static_cast<unsigned>(localport), static_cast<unsigned>(localport), reinterpret_cast<void*>(callback));
             return i;
         }
@@ -241,25 +399,29 @@ int32_t Begin(uint16_t localport, UdpCallbackFunctionPtr callback) {
 int32_t End(uint16_t localport) {
     UDP_DEBUG_PRINTF("localport=%u[%x]", static_cast<unsigned>(localport), static_cast<unsigned>(localport));
 
-    for (auto i = 0; i < UDP_MAX_PORTS_ALLOWED; i++) {
-        auto& info = s_ports[i].info;
+    const auto kIndex = Lookup(localport);
 
-        if (info.port == localport) {
-            info.callback = nullptr;
-            info.port = 0;
+    if (kIndex < 0) {
+        ERROR("Port not found.");
+        return -1;
+    }
 
-            auto& data = s_ports[i].data;
-            data.size = 0;
-            return 0;
-        }
+    HashRemove(kIndex);
+
+    auto& info = s_ports[kIndex];
+
+    if (info.data != nullptr) {
+        info.data->size = 0;
     }
 
-    ERROR("Port not found.");
-    return -1;
+    info.callback = nullptr;
+    info.data = nullptr;
+    info.port = 0;
+    return 0;
 }
 
-void Send(int32_t index, const uint8_t* data, uint32_t size, uint32_t remote_ip, uint16_t remote_port) {
-    SendImplementation<network::arp::EthSend::kIsNormal>(index, data, size, remote_ip, remote_port);
+bool Send(int32_t index, const uint8_t* data, uint32_t size, uint32_t remote_ip, uint16_t remote_port) {
+    return SendImplementation<network::arp::EthSend::kIsNormal>(index, data, size, remote_ip, remote_port);
 }
 
 #if defined CONFIG_NET_ENABLE_PTP
@@ -273,13 +435,13 @@ uint32_t Recv(int32_t index, const uint8_t** data, uint32_t* from_ip, uint16_t*
     assert(index >= 0);
     assert(index < UDP_MAX_PORTS_ALLOWED);
 
-    const auto& info = s_ports[index].info;
+    const auto& info = s_ports[index];
 
-    if (__builtin_expect(info.callback != nullptr, 0)) {
+    if (__builtin_expect((info.callback != nullptr) || (info.data == nullptr), 0)) {
         return 0;
     }
 
-    auto& port_data = s_ports[index].data;
+    auto& port_data = *info.data;
 
     if (__builtin_expect((port_data.size == 0), 1)) {
         return 0;
@@ -28,7 +28,9 @@
 #include <cstring>
 
 #include "emac_counters.h"
+#include "emac/emac.h"
 #include "emac/emac_phy.h"
+#include "core/ip4/igmp.h"
 #if defined(CONFIG_NET_ENABLE_PTP)
 #if !defined(DISABLE_RTC)
 #include "hwclock.h"
@@ -36,16 +38,38 @@
 #endif
 #include "emac/emac_debug.h"
 #include "gd32.h" // IWYU pragma: keep
+#include "gd32_enet.h"
 #include "../src/core/network_private.h"
 
 extern void EnetGpioConfig();
 extern enet_descriptors_struct txdesc_tab[ENET_TXBUF_NUM];
 extern void MacAddress(uint8_t paddr[]);
 
+#if !defined(ENET_DMA_SECTION)
+#define ENET_DMA_SECTION
+#endif
+
 #if defined(CONFIG_NET_ENABLE_PTP)
 #include "gd32_ptp.h"
-enet_descriptors_struct ptp_rxdesc_tab[ENET_RXBUF_NUM] __attribute__((aligned(4)));
-enet_descriptors_struct ptp_txdesc_tab[ENET_TXBUF_NUM] __attribute__((aligned(4)));
+enet_descriptors_struct ptp_rxdesc_tab[ENET_RXBUF_NUM] __attribute__((aligned(4))) ENET_DMA_SECTION;
+enet_descriptors_struct ptp_txdesc_tab[ENET_TXBUF_NUM] __attribute__((aligned(4))) ENET_DMA_SECTION;
+#endif
+
+/*
+ * CONFIG_EMAC_RXBUF_NUM, CONFIG_EMAC_TXBUF_NUM and CONFIG_EMAC_BUF_SIZE
+ * A frame is received and sent in a single descriptor.
+ */
+static_assert(ENET_RXBUF_NUM >= 2U, "The Rx ring needs at least 2 descriptors");
+static_assert(ENET_TXBUF_NUM >= 2U, "The Tx ring needs at least 2 descriptors");
+static_assert(ENET_RXBUF_SIZE >= ENET_MAX_FRAME_SIZE, "A frame must fit in one Rx buffer");
+static_assert(ENET_TXBUF_SIZE >= ENET_MAX_FRAME_SIZE, "A frame must fit in one Tx buffer");
+static_assert(ENET_RXBUF_SIZE <= 0x1FFFU, "RDES1 RB1S is 13 bits");
+static_assert((ENET_RXBUF_SIZE % 4U) == 0, "The buffers must be word aligned");
+
+#if defined(CONFIG_EMAC_PROMISCUOUS)
+static bool s_is_promiscuous = true;
+#else
+static bool s_is_promiscuous;
 #endif
 
 namespace emac::eth::globals {
@@ -85,6 +109,25 @@ void __attribute__((cold)) Config() {
     EMAC_DEBUG_EXIT();
 }
 
+void SetPromiscuous(bool enable) {
+    EMAC_DEBUG_ENTRY();
+    EMAC_DEBUG_PRINTF("enable=%d", enable);
+
+    s_is_promiscuous = enable;
+
+    if (enable) {
+        gd32::enet::FilterFeatureEnable<ENET_MAC_FRMF_FAR>();
+    } else {
+        gd32::enet::FilterFeatureDisable<ENET_MAC_FRMF_FAR>();
+    }
+
+    EMAC_DEBUG_EXIT();
+}
+
+bool IsPromiscuous() {
+    return s_is_promiscuous;
+}
+
 void AdjustLink(emac::phy::Status phy_status) {
     EMAC_DEBUG_ENTRY();
 
@@ -122,15 +165,20 @@ void AdjustLink(emac::phy::Status phy_status) {
         mediamode = ENET_10M_FULLDUPLEX;
     }
 
+    // Perfect unicast and broadcast, multicast as set by emac::multicast
+    const auto kRecept = s_is_promiscuous ? ENET_RECEIVEALL : ENET_BROADCAST_FRAMES_PASS;
+
 #if defined(GD32H7XX)
-    const auto kEnetInitStatus = enet_init(ENETx, mediamode, ENET_AUTOCHECKSUM_DROP_FAILFRAMES, ENET_RECEIVEALL);
+    const auto kEnetInitStatus = enet_init(ENETx, mediamode, ENET_AUTOCHECKSUM_DROP_FAILFRAMES, kRecept);
 #else
-    const auto kEnetInitStatus = enet_init(mediamode, ENET_AUTOCHECKSUM_DROP_FAILFRAMES, ENET_RECEIVEALL);
+    const auto kEnetInitStatus = enet_init(mediamode, ENET_AUTOCHECKSUM_DROP_FAILFRAMES, kRecept);
 #endif
 
     if (kEnetInitStatus != SUCCESS) {
     }
 
+    emac::multicast::Restore();
+
     EMAC_DEBUG_PRINTF("kEnetInitStatus=%s", kEnetInitStatus == SUCCESS ? "SUCCES" : "ERROR");
 
 #ifdef DEBUG_EMAC
@@ -157,7 +205,7 @@ void AdjustLink(emac::phy::Status phy_status) {
 
 void __attribute__((cold)) Start(uint8_t mac_address[], emac::phy::Link& link) {
     EMAC_DEBUG_ENTRY();
-    EMAC_DEBUG_PRINTF("ENET_RXBUF_NUM=%u, ENET_TXBUF_NUM=%u", ENET_RXBUF_NUM, ENET_TXBUF_NUM);
+    EMAC_DEBUG_PRINTF("ENET_RXBUF_NUM=%u, ENET_TXBUF_NUM=%u, ENET_RXBUF_SIZE=%u", ENET_RXBUF_NUM, ENET_TXBUF_NUM, ENET_RXBUF_SIZE);
 
     emac::phy::Status phy_status;
     emac::phy::Start(PHY_ADDRESS, phy_status);
@@ -67,7 +67,8 @@ void GetCounters(Counters& counters) {
     // send_busy is probably better as tx.drp than tx.err.
     // It means software could not queue a packet because DMA still owns desc.
     counters.tx.drp = emac::eth::globals::counter.send_busy;
-    counters.tx.err = 0;
+    // Error summary of the descriptors reclaimed
+    counters.tx.err = emac::eth::globals::counter.send_error;
     counters.tx.ovr = 0;
 }
 } // namespace network::iface
@@ -12,6 +12,7 @@ namespace emac::eth::globals {
 struct Counters {
     uint32_t sent;
     uint32_t send_busy;
+    uint32_t send_error;
     uint32_t received;
 };
 extern struct Counters counter;
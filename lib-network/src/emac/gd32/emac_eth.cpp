@@ -145,16 +145,42 @@ void FreePkt() {
 
 #if defined(CONFIG_NET_ENABLE_PTP)
 /**
- * @brief Retrieves the DMA buffer for Ethernet transmission with PTP.
+ * @brief Reserves the DMA buffer of the descriptor transmitted next, it does not wait.
  *
- * @return Pointer to the DMA buffer for transmission.
+ * The buffer is the one of dma_current_txdesc, the descriptor PtpFrameTransmit hands to the DMA.
+ * PtpFrameTransmit restores its buffer1_addr from the PTP table after a timestamp.
+ *
+ * @return Pointer to the DMA buffer, nullptr when the descriptor is owned by the DMA.
  */
-uint8_t* SendGetDmaBuffer() {
+uint8_t* SendReserve() {
+    if (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
+        emac::eth::globals::counter.send_busy++;
+        return nullptr;
+    }
+
+    assert(dma_current_txdesc->buffer1_addr == dma_current_ptp_txdesc->buffer1_addr);
+
+    return reinterpret_cast<uint8_t*>(dma_current_txdesc->buffer1_addr);
+}
+
+/**
+ * @brief Reserves as SendReserve, when no descriptor is free it waits for the DMA.
+ *
+ * For the frames that must not be dropped (ARP, ICMP). The DMA owns all descriptors,
+ * the oldest one is free after one frame time.
+ */
+static uint8_t* SendReserveWait() {
+    auto* dst = SendReserve();
+
+    if (dst != nullptr) {
+        return dst;
+    }
+
     while (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
-        __DMB(); ///< Wait until descriptor is available
+        __DMB();
     }
 
-    return reinterpret_cast<uint8_t*>(dma_current_ptp_txdesc->buffer1_addr);
+    return SendReserve();
 }
 
 /**
@@ -209,23 +235,6 @@ template <bool T> static void PtpFrameTransmit(uint32_t length) {
     }
 }
 
-/**
- * @brief Sends a PTP Ethernet frame.
- *
- * @tparam T Whether timestamping is enabled.
- * @param buffer Pointer to the frame buffer.
- * @param length Length of the frame in bytes.
- */
-template <bool T> static void PtpFrameTransmit(const void* buffer, uint32_t length) {
-    assert(nullptr != buffer);
-    assert(length <= ENET_MAX_FRAME_SIZE);
-
-    auto* dst = reinterpret_cast<uint8_t*>(dma_current_ptp_txdesc->buffer1_addr);
-    std::memcpy(dst, buffer, length); ///< Copy frame to DMA buffer
-
-    PtpFrameTransmit<T>(length);
-}
-
 /**
  * @brief Transmits an Ethernet frame without timestamping.
  *
@@ -255,8 +264,10 @@ void Send(void* buffer, const uint32_t length) {
     assert(nullptr != buffer);
     assert(length <= ENET_MAX_FRAME_SIZE);
 
-    while (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
-        __DMB(); // Wait until descriptor is available
+    auto* dst = SendReserveWait();
+
+    if (dst != buffer) {
+        std::memcpy(dst, buffer, length); ///< Copy frame to DMA buffer
     }
 
     auto status = dma_current_txdesc->status;
@@ -267,7 +278,7 @@ void Send(void* buffer, const uint32_t length) {
     __DMB();
 #endif
 
-    PtpFrameTransmit<false>(buffer, length);
+    PtpFrameTransmit<false>(length);
 }
 
 /**
@@ -299,8 +310,10 @@ void SendTimestamp(void* buffer, uint32_t length) {
     assert(nullptr != buffer);
     assert(length <= ENET_MAX_FRAME_SIZE);
 
-    while (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
-        __DMB();
+    auto* dst = SendReserveWait();
+
+    if (dst != buffer) {
+        std::memcpy(dst, buffer, length); ///< Copy frame to DMA buffer
     }
 
     auto status = dma_current_txdesc->status;
@@ -311,57 +324,151 @@ void SendTimestamp(void* buffer, uint32_t length) {
     __DMB();
 #endif
 
-    PtpFrameTransmit<true>(buffer, length);
+    PtpFrameTransmit<true>(length);
+}
+
+void SendCommit(uint32_t length) {
+    Send(length);
 }
+
+void SendFlush() {}
+
+void SendReclaim() {}
 #else
+/*
+ * TX ring: dma_current_txdesc is the next descriptor to fill,
+ * s_txdesc_reclaim the oldest one committed and not yet reclaimed.
+ */
+static enet_descriptors_struct* s_txdesc_reclaim;
+static uint32_t s_tx_committed; ///< Committed and not yet reclaimed
+static bool s_tx_flush;         ///< Committed since the last poll demand
+
+static void ReclaimOne() {
+    if (0 != (s_txdesc_reclaim->status & ENET_TDES0_ES)) {
+        emac::eth::globals::counter.send_error++;
+    } else {
+        emac::eth::globals::counter.sent++;
+    }
+
+    s_txdesc_reclaim = reinterpret_cast<enet_descriptors_struct*>(s_txdesc_reclaim->buffer2_next_desc_addr);
+    s_tx_committed--;
+}
+
 /**
- * @brief Retrieves the DMA buffer for Ethernet transmission.
+ * @brief One DMA poll demand for the frames committed.
+ */
+void SendFlush() {
+    if (s_tx_flush) {
+        s_tx_flush = false;
+        gd32::enet::ClearDmaTxFlagsAndResume(); ///< Handle transmission flags
+    }
+}
+
+/**
+ * @brief Reserves the DMA buffer of the next free descriptor, it does not wait.
  *
- * @return Pointer to the DMA buffer for transmission.
+ * @return Pointer to the DMA buffer, nullptr when all descriptors are owned by the DMA.
  */
-uint8_t* SendGetDmaBuffer() {
-    // The descriptor is busy due to own by the DMA
+uint8_t* SendReserve() {
     if (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
         emac::eth::globals::counter.send_busy++;
-        while (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
-            __DMB(); ///< Wait until descriptor is available
-        }
+        SendFlush(); ///< The DMA must not be suspended on a frame queued
+        return nullptr;
     }
 
     return reinterpret_cast<uint8_t*>(dma_current_txdesc->buffer1_addr);
 }
 
-// Transmits an Ethernet frame.
-void Send(uint32_t length) {
+/**
+ * @brief Reserves as SendReserve, when no descriptor is free it waits for the DMA.
+ *
+ * For the frames that must not be dropped (ARP, ICMP). The DMA owns all descriptors,
+ * the oldest one is free after one frame time.
+ */
+static uint8_t* SendReserveWait() {
+    auto* dst = SendReserve();
+
+    if (dst != nullptr) {
+        return dst;
+    }
+
+    while (0 != (dma_current_txdesc->status & ENET_TDES0_DAV)) {
+        __DMB();
+    }
+
+    return SendReserve();
+}
+
+/**
+ * @brief Queues the reserved buffer for transmission, without the DMA poll demand.
+ *
+ * @param length Length of the frame to transmit.
+ */
+void SendCommit(uint32_t length) {
+    assert(length <= ENET_MAX_FRAME_SIZE);
+    assert(0 == (dma_current_txdesc->status & ENET_TDES0_DAV));
+    assert(0 != (dma_current_txdesc->status & ENET_TDES0_TCHM)); /// Chained mode
+
     debug::Dump(reinterpret_cast<uint8_t*>(dma_current_txdesc->buffer1_addr), length);
 
-    dma_current_txdesc->control_buffer_size = length;              ///< Set the frame length
-    dma_current_txdesc->status |= ENET_TDES0_LSG | ENET_TDES0_FSG; ///< Set the segment of frame, frame is transmitted in one descriptor
-    dma_current_txdesc->status |= ENET_TDES0_DAV;                  ///< Enable DMA transmission
+    // All descriptors are committed, the current one is done and not yet reclaimed
+    if (s_tx_committed == ENET_TXBUF_NUM) {
+        ReclaimOne();
+    }
+
+    if (s_tx_committed == 0) {
+        s_txdesc_reclaim = dma_current_txdesc;
+    }
+
+    auto status = dma_current_txdesc->status;
+    status &= ~ENET_TDES0_ES;
+    status |= ENET_TDES0_LSG | ENET_TDES0_FSG; ///< Set the segment of frame, frame is transmitted in one descriptor
+
+    dma_current_txdesc->control_buffer_size = length; ///< Set the frame length
+    dma_current_txdesc->status = status;
+    dma_current_txdesc->status |= ENET_TDES0_DAV; ///< Enable DMA transmission
 
 #if defined(GD32H7XX)
     __DMB();
 #endif
 
-    gd32::enet::ClearDmaTxFlagsAndResume(); ///< Handle transmission flags
-
-    assert(0 != (dma_current_txdesc->status & ENET_TDES0_TCHM)); /// Chained mode
+    s_tx_committed++;
+    s_tx_flush = true;
 
     /// Update the current TxDMA descriptor pointer to the next descriptor in TxDMA descriptor table
     dma_current_txdesc = reinterpret_cast<enet_descriptors_struct*>(dma_current_txdesc->buffer2_next_desc_addr);
+}
+
+/**
+ * @brief Called from network::Run(), the descriptors transmitted are counted.
+ */
+void SendReclaim() {
+    SendFlush();
+
+    while ((s_tx_committed != 0) && (0 == (s_txdesc_reclaim->status & ENET_TDES0_DAV))) {
+        ReclaimOne();
+    }
+}
 
-    emac::eth::globals::counter.sent++;
+// Transmits an Ethernet frame.
+void Send(uint32_t length) {
+    SendCommit(length);
+    SendFlush();
 }
 
-// Transmits an Ethernet frame with data copying.
+// Transmits an Ethernet frame with data copying, it waits for a free descriptor.
 void Send(void* buffer, uint32_t length) {
     EMAC_DEBUG_PRINTF("%p -> %u", buffer, static_cast<unsigned>(length));
 
     assert(nullptr != buffer);
     assert(length <= ENET_MAX_FRAME_SIZE);
 
-    auto* dest = SendGetDmaBuffer();
-    std::memcpy(dest, buffer, length); ///< Copy frame to DMA buffer
+    auto* dest = SendReserveWait();
+
+    // UDP builds its datagram in the DMA buffer, ARP sends it from there
+    if (dest != buffer) {
+        std::memcpy(dest, buffer, length); ///< Copy frame to DMA buffer
+    }
 
     Send(length);
 }
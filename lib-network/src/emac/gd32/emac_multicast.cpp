@@ -25,9 +25,12 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+#include <cassert>
 
 #include "gd32_enet.h"
 #include "emac/emac_debug.h"
+#include "ip4/ip4_address.h"
 #include "gd32.h" // IWYU pragma: keep
 
 namespace network {
@@ -35,21 +38,59 @@ uint32_t Crc(const uint8_t* data, size_t length);
 }
 
 namespace emac::multicast {
+/*
+ * enet_init, see emac::AdjustLink, resets the frame filter and the hash table.
+ * The shadow is written back by Restore.
+ */
+static uint32_t s_hash_low;
+static uint32_t s_hash_high;
+static bool s_is_hash_filter;
+/*
+ * Different groups can share a hash bit, it is cleared when the last one leaves.
+ */
+static uint8_t s_hash_refs[64];
+
+static uint32_t Hash(const uint8_t* mac_addr) {
+    const auto kCrc = network::Crc(mac_addr, 6);
+    return (kCrc >> 26) & 0x3F;
+}
+
+void Restore() {
+    EMAC_IGMP_DEBUG_ENTRY();
+
+    if (s_is_hash_filter) {
+        gd32::enet::FilterFeatureDisable<ENET_MULTICAST_FILTER_PASS>();
+        gd32::enet::FilterFeatureEnable<ENET_MULTICAST_FILTER_HASH_MODE>();
+    } else {
+        gd32::enet::FilterFeatureDisable<ENET_MULTICAST_FILTER_HASH_MODE>();
+        gd32::enet::FilterFeatureEnable<ENET_MULTICAST_FILTER_PASS>();
+    }
+
+    gd32::enet::WriteHash(s_hash_low, s_hash_high);
+
+    EMAC_IGMP_DEBUG_PRINTF("%s HLH=%08x HLL=%08x", s_is_hash_filter ? "Hash" : "Pass", static_cast<unsigned>(s_hash_high), static_cast<unsigned>(s_hash_low));
+    EMAC_IGMP_DEBUG_EXIT();
+}
 
 void EnableHashFilter() {
     EMAC_IGMP_DEBUG_ENTRY();
 
-    gd32::enet::ResetHash();
-    gd32::enet::FilterFeatureDisable<ENET_MULTICAST_FILTER_PASS>();
-    gd32::enet::FilterFeatureEnable<ENET_MULTICAST_FILTER_HASH_MODE>();
+    s_hash_low = 0;
+    s_hash_high = 0;
+    memset(s_hash_refs, 0, sizeof(s_hash_refs));
+    s_is_hash_filter = true;
+
+    Restore();
 
     EMAC_IGMP_DEBUG_EXIT();
 }
+
 void DisableHashFilter() {
     EMAC_IGMP_DEBUG_ENTRY();
 
-    gd32::enet::FilterFeatureDisable<ENET_MULTICAST_FILTER_HASH_MODE>();
-    gd32::enet::FilterFeatureEnable<ENET_MULTICAST_FILTER_PASS>();
+    s_is_hash_filter = false;
+
+    Restore();
 
     EMAC_IGMP_DEBUG_EXIT();
 }
@@ -57,20 +98,54 @@ void DisableHashFilter() {
 void SetHash(const uint8_t* mac_addr) {
     EMAC_IGMP_DEBUG_ENTRY();
 
-    const auto kCrc = network::Crc(mac_addr, 6);
-    const auto kHash = (kCrc >> 26) & 0x3F;
+    const auto kHash = Hash(mac_addr);
+
+    assert(s_hash_refs[kHash] != UINT8_MAX);
+
+    if (s_hash_refs[kHash]++ == 0) {
+        if (kHash > 31) {
+            s_hash_high |= (1U << (kHash - 32));
+        } else {
+            s_hash_low |= (1U << kHash);
+        }
+
+        gd32::enet::FilterSetHash(kHash);
+    }
+
+    EMAC_IGMP_DEBUG_PRINTF("MAC: " MACSTR " -> Hash Index: %u, refs %u", MAC2STR(mac_addr), static_cast<unsigned>(kHash), static_cast<unsigned>(s_hash_refs[kHash]));
+    EMAC_IGMP_DEBUG_EXIT();
+}
+
+void ClearHash(const uint8_t* mac_addr) {
+    EMAC_IGMP_DEBUG_ENTRY();
+
+    const auto kHash = Hash(mac_addr);
 
-    gd32::enet::FilterSetHash(kHash);
+    assert(s_hash_refs[kHash] != 0);
 
-    EMAC_IGMP_DEBUG_PRINTF("MAC: " MACSTR " -> CRC32: 0x%08X -> Hash Index: %u", MAC2STR(mac_addr), static_cast<unsigned>(kCrc), static_cast<unsigned>(kHash));
+    if ((s_hash_refs[kHash] != 0) && (--s_hash_refs[kHash] == 0)) {
+        if (kHash > 31) {
+            s_hash_high &= ~(1U << (kHash - 32));
+        } else {
+            s_hash_low &= ~(1U << kHash);
+        }
+
+        gd32::enet::WriteHash(s_hash_low, s_hash_high);
+    }
+
+    EMAC_IGMP_DEBUG_PRINTF("MAC: " MACSTR " -> Hash Index: %u, refs %u", MAC2STR(mac_addr), static_cast<unsigned>(kHash), static_cast<unsigned>(s_hash_refs[kHash]));
     EMAC_IGMP_DEBUG_EXIT();
 }
 
 void ResetHash() {
     EMAC_IGMP_DEBUG_ENTRY();
 
+    s_hash_low = 0;
+    s_hash_high = 0;
+    memset(s_hash_refs, 0, sizeof(s_hash_refs));
+
     gd32::enet::ResetHash();
 
     EMAC_IGMP_DEBUG_EXIT();
 }
-} // namespace emac::multicast
\ No newline at end of file
+} // namespace emac::multicast
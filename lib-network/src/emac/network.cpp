@@ -349,6 +349,8 @@ void Shutdown() {
     network::apps::mdns::Stop();
 #endif
     network::igmp::Shutdown();
+    // The datagrams committed and not yet handed to the DMA
+    emac::eth::SendFlush();
     netif::SetLinkDown();
 
     NETWORK_DEBUG_EXIT();
@@ -36,6 +36,9 @@
 #endif
 #include "network.h"
 #include "configstore.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "softwaretimers.h"
+#endif
 
 #ifdef DEBUG_REMOTECONFIG
 #define REMOTECONFIG_DEBUG_ENTRY() DEBUG_ENTRY()
@@ -62,6 +65,10 @@ namespace udp {
 static constexpr auto kBufferSize = 1420;
 } // namespace udp
 
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+static constexpr uint32_t kConfirmMillis = 10000; ///< A pending slot is confirmed after the application has run this long
+#endif
+
 enum class Output {
     DMX,      //
     RDM,      //
@@ -120,6 +127,10 @@ class RemoteConfig {
     void PlatformHandleTftpSet();
     void PlatformHandleTftpGet();
 
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    void ConfirmTimer();
+#endif
+
     remoteconfig::Output output_;
     uint32_t active_outputs_;
 
@@ -155,7 +166,14 @@ class RemoteConfig {
     HttpDaemon* http_daemon_{nullptr};
 #endif
 
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    TimerHandle_t confirm_timer_id_{kTimerIdNone};
+#endif
+
     void static StaticCallbackFunction(const uint8_t* buffer, uint32_t size, uint32_t from_ip, uint16_t from_port) { RemoteConfig::Get()->Input(buffer, size, from_ip, from_port); }
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    void static StaticCallbackFunctionConfirmTimer([[maybe_unused]] TimerHandle_t handle) { RemoteConfig::Get()->ConfirmTimer(); }
+#endif
 
     static inline List s_list;
     static inline RemoteConfig* s_this;
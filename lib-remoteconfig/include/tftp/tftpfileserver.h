@@ -62,7 +62,7 @@ bool is_valid(const void* buffer);
 
 class TFTPFileServer final : public TFTPDaemon {
    public:
-    TFTPFileServer(uint8_t* buffer, uint32_t size);
+    TFTPFileServer();
     ~TFTPFileServer() override = default;
 
     bool FileOpen(const char* file_name, tftp::Mode mode) override;
@@ -70,17 +70,35 @@ class TFTPFileServer final : public TFTPDaemon {
     bool FileClose() override;
     size_t FileRead(void* buffer, size_t count, unsigned block_number) override;
     size_t FileWrite(const void* buffer, size_t count, unsigned block_number) override;
+    bool FileReserve(uint32_t size) override;
+    uint32_t FileSize() override { return read_size_; }
+    void FileAbort() override;
+    uint32_t FileBlockAlign() const override;
     void Exit() override;
 
     [[nodiscard]] uint32_t GetFileSize() const { return m_nFileSize; }
 
     bool IsDone() const { return m_bDone; }
+    bool HasError() const { return has_error_; }
 
    private:
-    uint8_t* buffer_;
-    uint32_t size_;
+    /*
+     * Read-only file, served straight from memory.
+     * nullptr when a file is being written.
+     */
+    const uint8_t* read_data_{nullptr};
+    uint32_t read_size_{0};
     uint32_t m_nFileSize{0};
+    uint32_t reserved_size_{0};
+    uint32_t progress_{0};
+#if defined(DEBUG_TFTP) && defined(GD32) && !defined(NO_EMAC)
+    uint32_t rx_ovr_{0};
+    uint32_t rx_drp_{0};
+#endif
     bool m_bDone{false};
+    bool has_error_{false};
+    bool is_delta_{false};
+    bool is_lz4_{false};
 };
 
 #endif // TFTP_TFTPFILESERVER_H_
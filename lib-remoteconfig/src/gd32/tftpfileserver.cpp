@@ -23,8 +23,11 @@
  * THE SOFTWARE.
  */
 
+#include "tftp/tftpfileserver.h"
+#include "firmware.h"
+
 namespace tftpfileserver {
-bool is_valid([[maybe_unused]] const void* buffer) {
-    return true;
+bool is_valid(const void* buffer) {
+    return firmware::image::is_valid(buffer);
 }
 } // namespace tftpfileserver
@@ -41,6 +41,9 @@
 #include "common/utils/utils_array.h"
 #include "display.h"
 #include "configstore.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "bootcontrol.h"
+#endif
 
 namespace remoteconfig::udp {
 static constexpr auto kPort = 0x2905;
@@ -93,7 +96,8 @@ RemoteConfig::RemoteConfig(remoteconfig::Output output, uint32_t active_outputs)
     s_list.output = static_cast<uint8_t>(output);
     s_list.active_outputs = static_cast<uint8_t>(active_outputs);
 
-    handle_ = network::udp::Begin(remoteconfig::udp::kPort, RemoteConfig::StaticCallbackFunction);
+    // The requests are handled, and answered, from the receive buffer
+    handle_ = network::udp::Begin(remoteconfig::udp::kPort, RemoteConfig::StaticCallbackFunction, network::udp::Mode::kZeroCopy);
     assert(handle_ != -1);
 
 #if !defined(CONFIG_REMOTECONFIG_MINIMUM)
@@ -114,12 +118,25 @@ RemoteConfig::RemoteConfig(remoteconfig::Output output, uint32_t active_outputs)
     params.Load();
     params.Set();
 #endif
+
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    // Not for the bootloader, it runs outside the slots
+    if (bootcontrol::SlotRunning() != bootcontrol::Slot::kNone) {
+        confirm_timer_id_ = SoftwareTimerAdd(remoteconfig::kConfirmMillis, StaticCallbackFunctionConfirmTimer);
+    }
+#endif
     REMOTECONFIG_DEBUG_EXIT();
 }
 
 RemoteConfig::~RemoteConfig() {
     REMOTECONFIG_DEBUG_ENTRY();
 
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+    if (confirm_timer_id_ != kTimerIdNone) {
+        SoftwareTimerDelete(confirm_timer_id_);
+    }
+#endif
+
 #if !defined(CONFIG_REMOTECONFIG_MINIMUM)
 #if defined(ENABLE_HTTPD)
 
@@ -162,6 +179,20 @@ void RemoteConfig::HandleFactory() {
     REMOTECONFIG_DEBUG_EXIT();
 }
 
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+/*
+ * The application has run long enough: a pending slot becomes the active slot.
+ * Without it, the bootloader rolls back after bootcontrol::kTries boots.
+ */
+void RemoteConfig::ConfirmTimer() {
+    SoftwareTimerDelete(confirm_timer_id_);
+
+    if (!bootcontrol::Confirm()) {
+        puts("Error: boot control confirm");
+    }
+}
+#endif
+
 void RemoteConfig::Input(const uint8_t* buffer, uint32_t size, uint32_t from_ip, [[maybe_unused]] uint16_t from_port) {
     udp_buffer_ = const_cast<char*>(reinterpret_cast<const char*>(buffer));
     bytes_received_ = size;
@@ -29,38 +29,27 @@
 
 #include "remoteconfig.h"
 #include "tftp/tftpfileserver.h"
-#include "flashcodeinstall.h"
-#include "firmware.h"
 #include "display.h"
 #include "firmware/debug/debug_debug.h"
 
-static uint8_t s_tftp_buffer[FIRMWARE_MAX_SIZE];
-
 void RemoteConfig::PlatformHandleTftpSet() {
     REMOTECONFIG_DEBUG_ENTRY();
 
     if (enable_tftp_ && (tftp_file_server_ == nullptr)) {
-        tftp_file_server_ = new TFTPFileServer(s_tftp_buffer, FIRMWARE_MAX_SIZE);
+        tftp_file_server_ = new TFTPFileServer;
         assert(m_pTFTPFileServer != nullptr);
         Display::Get()->TextStatus("TFTP On", ansi::Colours::Colour::kGreen);
     } else if (!enable_tftp_ && (tftp_file_server_ != nullptr)) {
-        const uint32_t kFileSize = tftp_file_server_->GetFileSize();
+        [[maybe_unused]] const uint32_t kFileSize = tftp_file_server_->GetFileSize();
         REMOTECONFIG_DEBUG_PRINTF("kFileSize=%u, %u", static_cast<unsigned>(kFileSize), static_cast<unsigned>(tftp_file_server_->IsDone()));
 
-        auto succes = true;
-
-        if (tftp_file_server_->IsDone()) {
-            succes = FlashCodeInstall::Get()->WriteFirmware(s_tftp_buffer, kFileSize);
-
-            if (!succes) {
-                Display::Get()->TextStatus("Error: TFTP", ansi::Colours::Colour::kRed);
-            }
-        }
+        // The firmware is already in flash, written while it was received.
+        const auto kSucces = !tftp_file_server_->HasError();
 
         delete tftp_file_server_;
         tftp_file_server_ = nullptr;
 
-        if (succes) { // Keep error message
+        if (kSucces) { // Keep error message
             Display::Get()->TextStatus("TFTP Off", ansi::Colours::Colour::kGreen);
         }
     }
@@ -32,13 +32,79 @@
 #include "remoteconfig.h"
 #include "display.h"
 #include "firmware.h"
+#include "flashcodeinstall.h"
+#if defined(CONFIG_FIRMWARE_LZ4)
+#include "lz4frame.h"
+#endif
+#include "configstore.h"
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+#include "bootcontrol.h"
+#endif
+#if defined(DEBUG_TFTP) && defined(GD32) && !defined(NO_EMAC)
+#include "network_iface.h"
+#endif
+
+/*
+ * The firmware is streamed into flash, block by block.
+ * Sectors are erased ahead of the write cursor by FlashCodeInstall.
+ * A write request for firmware::kFileName + ".delta" is a delta image,
+ * applied against the installed image (CONFIG_FIRMWARE_DELTA).
+ * A firmware::kFileName image that starts with the LZ4 frame magic is compressed,
+ * it is decompressed while it is written (CONFIG_FIRMWARE_LZ4).
+ *
+ * Read requests are served from read-only virtual files:
+ * - the application image, firmware::kFileName (the active slot)
+ * - the bootloader, "bootloader.bin"
+ * - the raw ConfigStore block, "configstore.bin"
+ * The flash images are memory mapped, the DATA blocks are copied
+ * straight from flash into the packet buffer.
+ */
 
-TFTPFileServer::TFTPFileServer(uint8_t* buffer, uint32_t size) : buffer_(buffer), size_(size) {
-    TFTP_DEBUG_ENTRY();
+namespace tftpfileserver {
+static constexpr char kFileNameBootloader[] = "bootloader.bin";
+static constexpr char kFileNameConfigStore[] = "configstore.bin";
+static constexpr char kFileNameDeltaSuffix[] = ".delta";
+} // namespace tftpfileserver
+
+#if defined(CONFIG_FIRMWARE_LZ4)
+static bool IsLz4(const void* buffer, size_t count) {
+    uint32_t magic;
+
+    if (count < sizeof(magic)) {
+        return false;
+    }
+
+    memcpy(&magic, buffer, sizeof(magic));
+    return magic == lz4::kFrameMagic;
+}
+#endif
+
+#if defined(GD32)
+/*
+ * A stamped image has its size in the image info (see firmware.h), it is served as stamped.
+ * An unstamped image is scanned: erased flash reads as 0xFF, the erased tail is not part of the image.
+ */
+static uint32_t ImageSize(const uint8_t* data, uint32_t max_size) {
+    uint32_t info[firmware::image::kInfoSize / 4];
+    memcpy(info, data + firmware::image::kInfoOffset, sizeof(info));
+
+    if ((info[0] == firmware::image::kMagic) && (info[1] >= (firmware::image::kInfoOffset + firmware::image::kInfoSize)) && (info[1] <= max_size)) {
+        return info[1];
+    }
 
-    assert(buffer_ != nullptr);
-    assert(size != 0);
+    const auto* words = reinterpret_cast<const uint32_t*>(data);
+    auto count = max_size / 4;
 
+    while ((count != 0) && (words[count - 1] == 0xFFFFFFFF)) {
+        count--;
+    }
+
+    return count * 4;
+}
+#endif
+
+TFTPFileServer::TFTPFileServer() {
+    TFTP_DEBUG_ENTRY();
     TFTP_DEBUG_EXIT();
 }
 
@@ -50,17 +116,57 @@ void TFTPFileServer::Exit() {
     TFTP_DEBUG_EXIT();
 }
 
-bool TFTPFileServer::FileOpen([[maybe_unused]] const char* file_name, [[maybe_unused]] tftp::Mode mode) {
+bool TFTPFileServer::FileOpen(const char* file_name, tftp::Mode mode) {
     TFTP_DEBUG_ENTRY();
 
+    assert(file_name != nullptr);
+
+    if (mode != tftp::Mode::kBinary) {
+        TFTP_DEBUG_EXIT();
+        return false;
+    }
+
+    read_data_ = nullptr;
+    read_size_ = 0;
+
+    if (strcmp(tftpfileserver::kFileNameConfigStore, file_name) == 0) {
+        read_data_ = ConfigStore::GetRaw();
+        read_size_ = ConfigStore::GetRawSize();
+    }
+#if defined(GD32)
+    else if (strcmp(firmware::kFileName, file_name) == 0) {
+#if defined(CONFIG_FIRMWARE_AB_SLOTS)
+        read_data_ = reinterpret_cast<const uint8_t*>(FLASH_BASE + bootcontrol::SlotOffset(bootcontrol::Active()));
+#else
+        read_data_ = reinterpret_cast<const uint8_t*>(FLASH_BASE + OFFSET_UIMAGE);
+#endif
+        read_size_ = ImageSize(read_data_, FIRMWARE_MAX_SIZE);
+    } else if (strcmp(tftpfileserver::kFileNameBootloader, file_name) == 0) {
+        read_data_ = reinterpret_cast<const uint8_t*>(FLASH_BASE);
+        read_size_ = ImageSize(read_data_, OFFSET_UIMAGE);
+    }
+#endif
+
+    if (read_data_ == nullptr) {
+        TFTP_DEBUG_EXIT();
+        return false;
+    }
+
+    TFTP_DEBUG_PRINTF("%s: %p, %u", file_name, static_cast<const void*>(read_data_), static_cast<unsigned>(read_size_));
+
+    Display::Get()->TextStatus("TFTP Read", ansi::Colours::Colour::kGreen);
+
     TFTP_DEBUG_EXIT();
-    return false;
+    return true;
 }
 
 bool TFTPFileServer::FileCreate(const char* file_name, tftp::Mode mode) {
     TFTP_DEBUG_ENTRY();
 
-    assert(pFileName != nullptr);
+    assert(file_name != nullptr);
+
+    read_data_ = nullptr;
+    read_size_ = 0;
 
     if (mode != tftp::Mode::kBinary) {
         TFTP_DEBUG_EXIT();
@@ -72,9 +178,44 @@ bool TFTPFileServer::FileCreate(const char* file_name, tftp::Mode mode) {
         return false;
     }
 
+    auto* flashcode_install = FlashCodeInstall::Get();
+
+    [[maybe_unused]] const auto* suffix = &file_name[firmware::kFileNameLength];
+    auto is_started = false;
+
+    is_delta_ = false;
+    is_lz4_ = false;
+
+#if defined(CONFIG_FIRMWARE_DELTA)
+    if (strcmp(suffix, tftpfileserver::kFileNameDeltaSuffix) == 0) {
+        is_delta_ = true;
+        is_started = flashcode_install->DeltaStart();
+    }
+#endif
+    // An LZ4 compressed image is known from the first block, see FileWrite
+    if (!is_delta_) {
+        is_started = flashcode_install->StreamStart();
+    }
+
+    if (!is_started) {
+        TFTP_DEBUG_EXIT();
+        return false;
+    }
+
     Display::Get()->TextStatus("TFTP Started", ansi::Colours::Colour::kGreen);
 
     m_nFileSize = 0;
+    reserved_size_ = 0;
+    progress_ = 0;
+    m_bDone = false;
+    has_error_ = false;
+
+#if defined(DEBUG_TFTP) && defined(GD32) && !defined(NO_EMAC)
+    network::iface::Counters counters;
+    network::iface::GetCounters(counters);
+    rx_ovr_ = counters.rx.ovr;
+    rx_drp_ = counters.rx.drp;
+#endif
 
     TFTP_DEBUG_EXIT();
     return (true);
@@ -83,46 +224,171 @@ bool TFTPFileServer::FileCreate(const char* file_name, tftp::Mode mode) {
 bool TFTPFileServer::FileClose() {
     TFTP_DEBUG_ENTRY();
 
+    if (read_data_ != nullptr) {
+        read_data_ = nullptr;
+        read_size_ = 0;
+
+        Display::Get()->TextStatus("TFTP Ended", ansi::Colours::Colour::kGreen);
+
+        TFTP_DEBUG_EXIT();
+        return true;
+    }
+
+    uint32_t write_count;
+
+    if (!FlashCodeInstall::Get()->WriteChunkComplete(write_count)) {
+        has_error_ = true;
+        Display::Get()->TextStatus("Error: TFTP", ansi::Colours::Colour::kRed);
+        TFTP_DEBUG_EXIT();
+        return false;
+    }
+
+    m_nFileSize = write_count;
     m_bDone = true;
 
+#if defined(DEBUG_TFTP) && defined(GD32) && !defined(NO_EMAC)
+    // The frames lost while the flash stalled the code (the sector erases)
+    network::iface::Counters counters;
+    network::iface::GetCounters(counters);
+    TFTP_DEBUG_PRINTF("Rx ovr %u drp %u during the install", static_cast<unsigned>(counters.rx.ovr - rx_ovr_), static_cast<unsigned>(counters.rx.drp - rx_drp_));
+#endif
+
     Display::Get()->TextStatus("TFTP Ended", ansi::Colours::Colour::kGreen);
 
     TFTP_DEBUG_EXIT();
     return true;
 }
 
-size_t TFTPFileServer::FileRead([[maybe_unused]] void* buffer, [[maybe_unused]] size_t count, [[maybe_unused]] unsigned block_number) {
+bool TFTPFileServer::FileReserve(uint32_t size) {
+    TFTP_DEBUG_ENTRY();
+    TFTP_DEBUG_PRINTF("size=%u", static_cast<unsigned>(size));
+
+    // The size of a delta image is not the size of the image
+    if (is_delta_) {
+        TFTP_DEBUG_EXIT();
+        return true;
+    }
+
+#if defined(CONFIG_FIRMWARE_LZ4)
+    // Nor is the size of a compressed image, that is known from the first block: FileWrite reserves
+#else
+    if (!FlashCodeInstall::Get()->StreamReserve(size)) {
+        has_error_ = true;
+        Display::Get()->TextStatus("Error: TFTP size", ansi::Colours::Colour::kRed);
+        TFTP_DEBUG_EXIT();
+        return false;
+    }
+#endif
+
+    reserved_size_ = size;
+
+    TFTP_DEBUG_EXIT();
+    return true;
+}
+
+void TFTPFileServer::FileAbort() {
     TFTP_DEBUG_ENTRY();
 
+    has_error_ = true;
+    Display::Get()->TextStatus("Error: TFTP timeout", ansi::Colours::Colour::kRed);
+
     TFTP_DEBUG_EXIT();
-    return 0;
 }
 
-size_t TFTPFileServer::FileWrite(const void* buffer, size_t count, unsigned block_number) {
-    TFTP_DEBUG_PRINTF("buffer=%p, count=%d, block_number=%d (%u)", buffer, static_cast<unsigned>(count), static_cast<unsigned>(block_number), static_cast<unsigned>(size_ / 512));
+uint32_t TFTPFileServer::FileBlockAlign() const {
+    return FlashCodeInstall::kWriteAlign;
+}
+
+size_t TFTPFileServer::FileRead(void* buffer, size_t count, unsigned block_number) {
+    TFTP_DEBUG_PRINTF("buffer=%p, count=%u, block_number=%u", buffer, static_cast<unsigned>(count), block_number);
+
+    assert(block_number != 0);
 
-    if (block_number > (size_ / 512)) {
-        m_nFileSize = 0;
+    if (read_data_ == nullptr) {
         return 0;
     }
 
+    const auto kOffset = (block_number - 1) * TFTPDaemon::GetBlockSize();
+
+    if (kOffset >= read_size_) {
+        return 0; // The size is a multiple of the block size: empty last block
+    }
+
+    const auto kLength = (read_size_ - kOffset) < count ? (read_size_ - kOffset) : static_cast<uint32_t>(count);
+
+    memcpy(buffer, &read_data_[kOffset], kLength);
+
+    Display::Get()->Progress();
+
+    return kLength;
+}
+
+size_t TFTPFileServer::FileWrite(const void* buffer, size_t count, unsigned block_number) {
+    TFTP_DEBUG_PRINTF("buffer=%p, count=%d, block_number=%d", buffer, static_cast<unsigned>(count), static_cast<unsigned>(block_number));
+
     assert(block_number != 0);
 
-    if (block_number == 1) {
+    const auto kOffset = (block_number - 1) * TFTPDaemon::GetBlockSize();
+    auto* flashcode_install = FlashCodeInstall::Get();
+
+    // Retransmitted block, our ACK got lost: it is already in flash.
+    if (kOffset < flashcode_install->GetWriteCount()) {
+        return count;
+    }
+
+    if (kOffset != flashcode_install->GetWriteCount()) {
+        has_error_ = true;
+        return 0;
+    }
+
+    if ((block_number == 1) && !is_delta_) {
+#if defined(CONFIG_FIRMWARE_LZ4)
+        is_lz4_ = IsLz4(buffer, count);
+
+        if (is_lz4_) {
+            // The image size is in the frame header, or is known at the end
+            if (!flashcode_install->Lz4Start()) {
+                has_error_ = true;
+                return 0;
+            }
+        } else if (!tftpfileserver::is_valid(buffer)) {
+            has_error_ = true;
+            return 0;
+        } else if ((reserved_size_ != 0) && !flashcode_install->StreamReserve(reserved_size_)) {
+            has_error_ = true;
+            Display::Get()->TextStatus("Error: TFTP size", ansi::Colours::Colour::kRed);
+            return 0;
+        }
+#else
         if (!tftpfileserver::is_valid(buffer)) {
+            has_error_ = true;
             return 0;
         }
+#endif
     }
 
-    const auto kOffset = (block_number - 1) * 512U;
+    uint32_t written;
 
-    assert((kOffset + count) <= size_);
+    if (!flashcode_install->WriteChunk(static_cast<const uint8_t*>(buffer), static_cast<uint32_t>(count), written)) {
+        has_error_ = true;
+        Display::Get()->TextStatus("Error: TFTP", ansi::Colours::Colour::kRed);
+        return 0;
+    }
 
-    memcpy(&buffer_[kOffset], buffer, count);
+    m_nFileSize = written;
 
-    m_nFileSize += count; // FIXME BUG When in retry ?
+    if (reserved_size_ != 0) {
+        const auto kProgress = (written * 100U) / reserved_size_;
 
-    Display::Get()->Progress();
+        if (kProgress != progress_) {
+            progress_ = kProgress;
+            char text[16];
+            snprintf(text, sizeof(text), "TFTP %u%%", static_cast<unsigned>(kProgress));
+            Display::Get()->TextStatus(text);
+        }
+    } else {
+        Display::Get()->Progress();
+    }
 
     return count;
 }